@@ -65,12 +65,18 @@ public:
 		glUniformMatrix4fv(view_loc, 1, GL_FALSE, glm::value_ptr(view));
 		glUniformMatrix4fv(proj_loc, 1, GL_FALSE, glm::value_ptr(proj));
 
+		updateFrustum();
+
 		for (unsigned int i = 0; i < world->bodies.size(); ++i)
 		{
-			fiz::Body& body = world->bodies[i];
+			// the world keeps every body's box current, so culling costs six plane tests
+			if (!isVisible(world->bodies.bounds[i]))
+				continue;
+
+			fiz::Body body = world->bodies[i];
 
 			glm::mat4 model(1.0f);
-			model = glm::translate(model, body.m_Pos);
+			model = glm::translate(model, body.getPosition());
 			glUniformMatrix4fv(model_loc, 1, GL_FALSE, glm::value_ptr(model));
 
 			for (unsigned int j = 0; j < body.shapes.size(); ++j)
@@ -134,4 +140,32 @@ private:
 	unsigned int proj_loc;
 
 	unsigned int scale_loc;
+
+	glm::vec4 frustum[6]; // planes facing inwards, from the current projection and view
+
+	// the planes are sums and differences of the rows of the clip space transform
+	void updateFrustum()
+	{
+		glm::mat4 clip = glm::transpose(proj * view);
+		for (int k = 0; k < 3; ++k)
+		{
+			frustum[k * 2] = clip[3] + clip[k];
+			frustum[k * 2 + 1] = clip[3] - clip[k];
+		}
+	}
+
+	// false only if the box is completely behind one of the planes
+	bool isVisible(const fiz::Bounds& box) const
+	{
+		for (int k = 0; k < 6; ++k)
+		{
+			const glm::vec4& plane = frustum[k];
+			glm::vec3 corner(plane.x >= 0.0f ? box.max.x : box.min.x,
+							 plane.y >= 0.0f ? box.max.y : box.min.y,
+							 plane.z >= 0.0f ? box.max.z : box.min.z);
+			if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+				return false;
+		}
+		return true;
+	}
 };
\ No newline at end of file
@@ -3,29 +3,317 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "geometry/Shape.h"
+#include "geometry/Bounds.h"
+#include "util/AlignedAllocator.h"
 
 #include <vector>
+#include <utility>
+#include <cassert>
 
 namespace fiz
 {
+	typedef std::vector<float, AlignedAllocator<float, 32>> FloatArray;
+
+	class Body;
+
+	namespace body_detail
+	{
+		template<typename Array>
+		inline void removeSwap(Array& array, unsigned int index)
+		{
+			if (index + 1 != array.size())
+				array[index] = std::move(array.back());
+			array.pop_back();
+		}
+	}
+
+	// shapes of one body. Nearly every body has a single shape, which is stored in place, so reaching it
+	// is one load and a body costs no allocation. Compound bodies keep the others in a vector
+	class ShapeList
+	{
+	public:
+		ShapeList() : first(nullptr)
+		{
+
+		}
+
+		unsigned int size() const
+		{
+			return first ? 1 + (unsigned int)others.size() : 0;
+		}
+		bool empty() const
+		{
+			return first == nullptr;
+		}
+
+		Shape* operator[](unsigned int i) const
+		{
+			return i == 0 ? first : others[i - 1];
+		}
+
+		void push_back(Shape* shape)
+		{
+			if (!first)
+				first = shape;
+			else
+				others.push_back(shape);
+		}
+
+	private:
+		Shape* first;
+		std::vector<Shape*> others;
+	};
+
+	// stable reference to a body. Indices change when other bodies are removed, handles don't, and a
+	// handle to a removed body is told apart from the body that reuses its slot by the generation
+	struct BodyHandle
+	{
+		unsigned int slot;
+		unsigned int generation;
+
+		BodyHandle() : slot(0xffffffff), generation(0) {}
+		BodyHandle(unsigned int slot, unsigned int generation) : slot(slot), generation(generation) {}
+
+		bool operator==(const BodyHandle& other) const { return slot == other.slot && generation == other.generation; }
+		bool operator!=(const BodyHandle& other) const { return !(*this == other); }
+	};
+
+	struct BodySlot
+	{
+		unsigned int index; // current index of the body, invalid_index while the slot is unused
+		unsigned int generation;
+	};
+
+	// every body property in its own array, so the integrator and the solver only stream through what
+	// they use. Index i in each array belongs to the same body. The float arrays are 32 byte aligned.
+	// Removing a body moves the last one into its place, handles go through the slot table
+	class BodyStorage
+	{
+	public:
+		static const unsigned int invalid_index = 0xffffffff;
+
+		FloatArray pos_x, pos_y, pos_z;
+		FloatArray vel_x, vel_y, vel_z;
+		FloatArray force_x, force_y, force_z; // accumulated until the next step
+		FloatArray inv_mass;                  // 0 for bodies with no mass, they don't react to contacts
+		FloatArray ground_offset;             // height of the first shape's lowest point relative to the position
+
+		std::vector<float> mass;
+		std::vector<float> density;
+		std::vector<float> friction;
+		std::vector<float> restitution;
+		std::vector<glm::mat3> inertia_tensor;
+
+		std::vector<unsigned char> awake;
+		std::vector<float> sleep_time;    // seconds spent moving slower than the sleep velocity
+		std::vector<unsigned int> island; // contact island from the last step
+
+		std::vector<ShapeList> shapes;
+		std::vector<Bounds> local_bounds; // around all shapes, relative to the position
+		std::vector<Bounds> bounds;       // world space, kept current for moving bodies by World::step
+
+		std::vector<unsigned int> slot;    // slot of each body, pair caches are keyed by it since it doesn't move
+		std::vector<BodySlot> slots;       // indexed by BodyHandle::slot
+		std::vector<unsigned int> retired; // slots of removed bodies, not reused until recycleSlots()
+
+		unsigned int size() const
+		{
+			return (unsigned int)pos_x.size();
+		}
+		bool empty() const
+		{
+			return pos_x.empty();
+		}
+
+		// appends a body at rest with no shapes
+		inline Body add(glm::vec3 pos);
+		inline Body operator[](unsigned int i);
+		inline Body operator[](BodyHandle handle);
+
+		// moves the last body into index. Indices of other bodies stay the same
+		void remove(unsigned int index)
+		{
+			unsigned int last = size() - 1;
+			BodySlot& removed = slots[slot[index]];
+			removed.index = invalid_index;
+			++removed.generation;
+			retired.push_back(slot[index]);
+			if (index != last)
+				slots[slot[last]].index = index;
+
+			body_detail::removeSwap(pos_x, index); body_detail::removeSwap(pos_y, index); body_detail::removeSwap(pos_z, index);
+			body_detail::removeSwap(vel_x, index); body_detail::removeSwap(vel_y, index); body_detail::removeSwap(vel_z, index);
+			body_detail::removeSwap(force_x, index); body_detail::removeSwap(force_y, index); body_detail::removeSwap(force_z, index);
+			body_detail::removeSwap(inv_mass, index);
+			body_detail::removeSwap(ground_offset, index);
+			body_detail::removeSwap(mass, index);
+			body_detail::removeSwap(density, index);
+			body_detail::removeSwap(friction, index);
+			body_detail::removeSwap(restitution, index);
+			body_detail::removeSwap(inertia_tensor, index);
+			body_detail::removeSwap(awake, index);
+			body_detail::removeSwap(sleep_time, index);
+			body_detail::removeSwap(island, index);
+			body_detail::removeSwap(shapes, index);
+			body_detail::removeSwap(local_bounds, index);
+			body_detail::removeSwap(bounds, index);
+			body_detail::removeSwap(slot, index);
+		}
+
+		// retired slots become free once nothing keyed by them is left
+		void recycleSlots()
+		{
+			free_slots.insert(free_slots.end(), retired.begin(), retired.end());
+			retired.clear();
+		}
+
+		BodyHandle getHandle(unsigned int i) const
+		{
+			return BodyHandle(slot[i], slots[slot[i]].generation);
+		}
+		bool isValid(BodyHandle handle) const
+		{
+			return handle.slot < slots.size() && slots[handle.slot].generation == handle.generation && slots[handle.slot].index != invalid_index;
+		}
+		// invalid_index for a removed body
+		unsigned int indexOf(BodyHandle handle) const
+		{
+			return isValid(handle) ? slots[handle.slot].index : invalid_index;
+		}
+
+		void reserve(unsigned int count)
+		{
+			pos_x.reserve(count); pos_y.reserve(count); pos_z.reserve(count);
+			vel_x.reserve(count); vel_y.reserve(count); vel_z.reserve(count);
+			force_x.reserve(count); force_y.reserve(count); force_z.reserve(count);
+			inv_mass.reserve(count);
+			ground_offset.reserve(count);
+			mass.reserve(count);
+			density.reserve(count);
+			friction.reserve(count);
+			restitution.reserve(count);
+			inertia_tensor.reserve(count);
+			awake.reserve(count);
+			sleep_time.reserve(count);
+			island.reserve(count);
+			shapes.reserve(count);
+			local_bounds.reserve(count);
+			bounds.reserve(count);
+			slot.reserve(count);
+		}
+		void clear()
+		{
+			pos_x.clear(); pos_y.clear(); pos_z.clear();
+			vel_x.clear(); vel_y.clear(); vel_z.clear();
+			force_x.clear(); force_y.clear(); force_z.clear();
+			inv_mass.clear();
+			ground_offset.clear();
+			mass.clear();
+			density.clear();
+			friction.clear();
+			restitution.clear();
+			inertia_tensor.clear();
+			awake.clear();
+			sleep_time.clear();
+			island.clear();
+			shapes.clear();
+			local_bounds.clear();
+			bounds.clear();
+			slot.clear();
+			slots.clear();
+			retired.clear();
+			free_slots.clear();
+		}
+
+		inline glm::vec3 getPosition(unsigned int i) const
+		{
+			return glm::vec3(pos_x[i], pos_y[i], pos_z[i]);
+		}
+		inline void setPosition(unsigned int i, glm::vec3 pos)
+		{
+			pos_x[i] = pos.x;
+			pos_y[i] = pos.y;
+			pos_z[i] = pos.z;
+			updateBounds(i);
+		}
+
+		// world space bounds from the position and the cached local bounds
+		inline void updateBounds(unsigned int i)
+		{
+			glm::vec3 pos = getPosition(i);
+			bounds[i] = Bounds(pos + local_bounds[i].min, pos + local_bounds[i].max);
+		}
+		inline glm::vec3 getVelocity(unsigned int i) const
+		{
+			return glm::vec3(vel_x[i], vel_y[i], vel_z[i]);
+		}
+		inline void setVelocity(unsigned int i, glm::vec3 vel)
+		{
+			vel_x[i] = vel.x;
+			vel_y[i] = vel.y;
+			vel_z[i] = vel.z;
+		}
+
+	private:
+		std::vector<unsigned int> free_slots;
+	};
+
+	// view of one body in a BodyStorage. Cheap to copy, valid until bodies are added or removed
 	class Body
 	{
 	public:
-		glm::vec3 m_Pos;
-		glm::vec3 m_Vel;
+		ShapeList& shapes;
 
-		float m_Friction;
-		float m_Restitutiton;
+		Body(BodyStorage& storage, unsigned int index) : shapes(storage.shapes[index]), storage(&storage), index(index)
+		{
 
-		std::vector<Shape*> shapes;
+		}
 
-		Body() : m_Pos(0.0f, 0.0f, 0.0f), m_Vel(0.0f, 0.0f, 0.0f), m_Friction(0.0f), m_Restitutiton(0.0f), m_Density(1.0f), m_Mass(0.0f), m_InertiaTensor(1.0f)
+		unsigned int getIndex() const
 		{
+			return index;
+		}
 
+		glm::vec3 getPosition() const
+		{
+			return storage->getPosition(index);
+		}
+		// moving a body by hand wakes it, like applyForce
+		void setPosition(glm::vec3 pos)
+		{
+			storage->setPosition(index, pos);
+			wake();
+		}
+		glm::vec3 getVelocity() const
+		{
+			return storage->getVelocity(index);
 		}
-		Body(glm::vec3 pos) : m_Pos(pos), m_Vel(0.0f, 0.0f, 0.0f), m_Friction(0.0f), m_Restitutiton(0.0f), m_Density(1.0f), m_Mass(0.0f), m_InertiaTensor(1.0f)
+		void setVelocity(glm::vec3 vel)
 		{
+			storage->setVelocity(index, vel);
+			wake();
+		}
 
+		BodyHandle getHandle() const
+		{
+			return storage->getHandle(index);
+		}
+
+		float getFriction() const
+		{
+			return storage->friction[index];
+		}
+		void setFriction(float friction)
+		{
+			storage->friction[index] = friction;
+		}
+		float getRestitution() const
+		{
+			return storage->restitution[index];
+		}
+		void setRestitution(float restitution)
+		{
+			storage->restitution[index] = restitution;
 		}
 
 		void addShape(Shape* shape)
@@ -33,35 +321,145 @@ namespace fiz
 			shapes.push_back(shape);
 
 			updateMass();
+			updateShapeBounds();
+		}
+
+		// call after changing the geometry of one of the shapes. The bounds and the ground clamp's lowest
+		// point are cached per body
+		void updateShapeBounds()
+		{
+			Bounds b;
+			for (unsigned int i = 0; i < shapes.size(); ++i)
+			{
+				Bounds shape_bounds = shapes[i]->computeLocalBounds();
+				if (i == 0)
+				{
+					b = shape_bounds;
+					storage->ground_offset[index] = shape_bounds.min.y;
+				}
+				else
+				{
+					b.merge(shape_bounds);
+				}
+			}
+			if (shapes.empty())
+				storage->ground_offset[index] = 0.0f;
+
+			storage->local_bounds[index] = b;
+			storage->updateBounds(index);
 		}
 
 		float setDensity(float density) // returns mass
 		{
-			m_Density = density;
+			storage->density[index] = density;
 
 			updateMass();
+
+			return storage->mass[index];
 		}
 
 		float getMass() const
 		{
-			return m_Mass;
+			return storage->mass[index];
 		}
 
-	private:
+		float getInverseMass() const // 0 for bodies with no mass, they don't react to contacts
+		{
+			return storage->inv_mass[index];
+		}
+
+		void applyForce(glm::vec3 force)
+		{
+			storage->force_x[index] += force.x;
+			storage->force_y[index] += force.y;
+			storage->force_z[index] += force.z;
+			wake();
+		}
 
-		glm::mat3 m_InertiaTensor;
+		unsigned int getIsland() const
+		{
+			return storage->island[index];
+		}
+
+		bool isAwake() const
+		{
+			return storage->awake[index] != 0;
+		}
+		void wake()
+		{
+			storage->awake[index] = 1;
+			storage->sleep_time[index] = 0.0f;
+		}
+		void sleep() // sleeping bodies are skipped by integration, bounds updates and the narrowphase
+		{
+			storage->awake[index] = 0;
+			storage->setVelocity(index, glm::vec3(0.0f, 0.0f, 0.0f));
+			storage->force_x[index] = 0.0f;
+			storage->force_y[index] = 0.0f;
+			storage->force_z[index] = 0.0f;
+		}
 
-		float m_Density;
-		float m_Mass;
+	private:
+		BodyStorage* storage;
+		unsigned int index;
 
 		void updateMass()
 		{
-			m_Mass = 0.0f;
+			float mass = 0.0f;
 			for (unsigned int i = 0; i < shapes.size(); ++i)
 			{
-				m_Mass += shapes[i]->computeVolume();
+				mass += shapes[i]->computeVolume();
 			}
-			m_Mass *= m_Density;
+			mass *= storage->density[index];
+
+			storage->mass[index] = mass;
+			storage->inv_mass[index] = mass > 0.0f ? 1.0f / mass : 0.0f;
 		}
 	};
-}
\ No newline at end of file
+
+	inline Body BodyStorage::add(glm::vec3 pos)
+	{
+		pos_x.push_back(pos.x); pos_y.push_back(pos.y); pos_z.push_back(pos.z);
+		vel_x.push_back(0.0f); vel_y.push_back(0.0f); vel_z.push_back(0.0f);
+		force_x.push_back(0.0f); force_y.push_back(0.0f); force_z.push_back(0.0f);
+		inv_mass.push_back(0.0f);
+		ground_offset.push_back(0.0f);
+		mass.push_back(0.0f);
+		density.push_back(1.0f);
+		friction.push_back(0.0f);
+		restitution.push_back(0.0f);
+		inertia_tensor.push_back(glm::mat3(1.0f));
+		awake.push_back(1);
+		sleep_time.push_back(0.0f);
+		island.push_back(0);
+		shapes.emplace_back();
+		local_bounds.emplace_back();
+		bounds.emplace_back(pos, pos);
+
+		unsigned int index = size() - 1;
+		if (free_slots.empty())
+		{
+			BodySlot entry;
+			entry.generation = 0;
+			slots.push_back(entry);
+			free_slots.push_back((unsigned int)slots.size() - 1);
+		}
+		slot.push_back(free_slots.back());
+		slots[free_slots.back()].index = index;
+		free_slots.pop_back();
+
+		return Body(*this, index);
+	}
+
+	inline Body BodyStorage::operator[](unsigned int i)
+	{
+		return Body(*this, i);
+	}
+
+	// the handle has to be valid, check with isValid or go through indexOf otherwise
+	inline Body BodyStorage::operator[](BodyHandle handle)
+	{
+		assert(isValid(handle));
+		return Body(*this, slots[handle.slot].index);
+	}
+}
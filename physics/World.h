@@ -1,44 +1,56 @@
 #pragma once
 #include <vector>
+#include <stdexcept>
 #include <stdlib.h>
 
 #include "Body.h"
 #include "geometry/Shape.h"
+#include "geometry/ShapePool.h"
+#include "geometry/Bounds.h"
+#include "broadphase/Broadphase.h"
+#include "broadphase/SweepAndPrune.h"
+#include "broadphase/DynamicTree.h"
+#include "broadphase/SpatialHash.h"
+#include "collision/Collide.h"
+#include "collision/PairCache.h"
+#include "collision/Manifold.h"
+#include "collision/Narrowphase.h"
+#include "dynamics/ContactSolver.h"
+#include "dynamics/Islands.h"
+#include "dynamics/Integrator.h"
+#include "util/ThreadPool.h"
+#include "util/FrameArena.h"
 
 namespace fiz
 {
-#define triple_cross(x, y) glm::cross(glm::cross(x, y), x)
-
-	struct Simplex
+	class World
 	{
-		glm::vec3 vertices[4];
-		unsigned int length;
+	public:
+		unsigned int iters; // solver iterations per step
 
-		Simplex() : vertices(), length(0) {}
+		float sleep_velocity; // bodies slower than this count towards sleeping
+		float sleep_time;     // seconds a whole island has to stay slow before it sleeps
 
-		void addVertex(glm::vec3& vertex)
-		{
-			vertices[length] = vertex;
-			++length;
-		}
-	};
+		ShapePool shapes;
+		BodyStorage bodies; // bodies.bounds holds each body's world space box, current after every step
 
-	class World
-	{
-	public:
-		unsigned int iters;
+		// per step data comes from here and is released at the end of step. Its capacity grows to what
+		// a step needs, set it up front to skip the warmup
+		FrameArena arena;
 
-		std::vector<Shape*> shapes;
-		std::vector<Body> bodies;
+		FrameVector<BodyPair> pairs;     // broadphase pairs, valid until the end of step
+		FrameVector<Manifold*> contacts; // manifolds solved this step, valid until the end of step
 
 		inline float random()
 		{
 			return (float)(rand() % 1000) / 1000.0f;
 		}
 
-		World() : gravity(0.0f, -9.8f, 0.0f)
+		World() : iters(4), sleep_velocity(0.25f), sleep_time(0.5f), gravity(0.0f, -9.8f, 0.0f), broadphase(new SweepAndPrune()), pool(new ThreadPool(0)), island_count(0),
+			last_pair_count(0), last_contact_count(0)
 		{
-			shapes.reserve(100);
+			solver.pool = pool;
+
 			bodies.reserve(100);
 
 			srand(5);
@@ -51,10 +63,8 @@ namespace fiz
 					float x = random() * 10.0f - 5.0f;
 					float y = random() * 5.0f + 1.0f;
 					float z = random() * 10.0f - 5.0f;
-					Sphere* sphere = new Sphere(glm::vec3(0.0f, 0.0f, 0.0f), r);
-					shapes.push_back((Shape*)sphere);
-					bodies.emplace_back(glm::vec3(x, y, z));
-					bodies[bodies.size() - 1].addShape((Shape*)sphere);
+					ShapeHandle sphere = createShape<Sphere>(glm::vec3(0.0f, 0.0f, 0.0f), r);
+					bodies.add(glm::vec3(x, y, z)).addShape(getShape(sphere));
 				}
 				else
 				{
@@ -66,219 +76,328 @@ namespace fiz
 					float sy = random() * 0.5f + 0.5f;
 					float sz = random() * 0.5f + 0.5f;
 
-					AABB* aabb = new AABB(glm::vec3(-sx, -sy, -sz), glm::vec3(sx, sy, sz));
-					shapes.push_back((Shape*)aabb);
-					bodies.emplace_back(glm::vec3(x, y, z));
-					bodies[bodies.size() - 1].addShape((Shape*)aabb);
+					ShapeHandle aabb = createShape<AABB>(glm::vec3(-sx, -sy, -sz), glm::vec3(sx, sy, sz));
+					bodies.add(glm::vec3(x, y, z)).addShape(getShape(aabb));
 				}
 			}
 		}
-		~World() {}
-
-		Shape* createShape() {}
+		~World()
+		{
+			delete broadphase;
+			delete pool;
+		}
 
-		void step(float dt)
+		// the world owns its shapes, whatever is left is freed with it
+		template<typename T, typename... Args>
+		ShapeHandle createShape(Args&&... args)
+		{
+			return shapes.create<T>(std::forward<Args>(args)...);
+		}
+		// stays valid until the shape is destroyed, nullptr after
+		Shape* getShape(ShapeHandle handle)
 		{
-			float l = 10.0f;
-			float res = 0.9f;
+			return shapes.get(handle);
+		}
+		// the shape must not be attached to any body anymore
+		void destroyShape(ShapeHandle handle)
+		{
+			shapes.destroy(handle);
+		}
 
-			for (unsigned int i = 0; i < bodies.size(); ++i)
-			{
-				bodies[i].m_Vel += gravity * dt;
-				bodies[i].m_Pos += bodies[i].m_Vel * dt;
+		// worker threads used by the parallel stages, 0 runs everything on the calling thread
+		void setThreadCount(unsigned int count)
+		{
+			delete pool;
+			pool = new ThreadPool(count);
+			solver.pool = pool;
+		}
 
-				glm::vec3 lowest = bodies[i].shapes[0]->support(glm::vec3(0.0f, -1.0f, 0.0f));
-				lowest += bodies[i].m_Pos;
+		void setSolverMode(SolverMode mode)
+		{
+			solver.mode = mode;
+		}
 
-				if (lowest.y < 0.0f)
-				{
-					bodies[i].m_Pos.y = bodies[i].m_Pos.y - lowest.y;
-					bodies[i].m_Vel.y *= -res;
-				}
-				if (bodies[i].m_Pos.y > 30.0f)
-				{
-					bodies[i].m_Pos.y = 30.0f;
-					bodies[i].m_Vel.y = 0;
-				}
-				
-			}
-			for (unsigned int x = 0; x < 8; ++x)
+		// switches to a broadphase with its default settings
+		void setBroadphase(BroadphaseType type)
+		{
+			switch (type)
 			{
-				for (unsigned int i = 0; i < bodies.size(); ++i)
-				{
-					for (unsigned int j = 0; j < i; ++j)
-					{
-						glm::vec3 normal = intersectionNormal(&bodies[i], &bodies[j]);
-						//bodies[j].m_Pos += normal;
-
-						if (normal != glm::vec3())
-						{
-							//solveCollision(bodies[i].getMass(), bodies[j].getMass(), bodies[i].m_Vel, bodies[j].m_Vel, normal);
-						}
-					}
-				}
+			case SWEEP_AND_PRUNE_BROADPHASE:
+				setBroadphase(new SweepAndPrune());
+				break;
+			case DYNAMIC_TREE_BROADPHASE:
+				setBroadphase(new DynamicTree());
+				break;
+			case SPATIAL_HASH_BROADPHASE:
+				setBroadphase(new SpatialHash());
+				break;
 			}
 		}
-	private:
+		// the world takes ownership. For tuned broadphases, e.g. setBroadphase(new SpatialHash(1.5f)) or
+		// setBroadphase(new DynamicTree(0.2f)), the caller can keep the pointer to adjust them later
+		void setBroadphase(Broadphase* custom)
+		{
+			delete broadphase;
+			broadphase = custom;
+		}
 
-		glm::vec3 gravity;
+		// handles stay valid until the body is destroyed, indices and Body views only until a body is removed.
+		// A destroyed body's handle stays invalid even once its slot holds a new body, isValid tells
+		BodyHandle createBody(glm::vec3 pos)
+		{
+			return bodies.add(pos).getHandle();
+		}
+		// throws std::out_of_range for a handle that is no longer valid
+		Body getBody(BodyHandle handle)
+		{
+			unsigned int index = bodies.indexOf(handle);
+			if (index == BodyStorage::invalid_index)
+				throw std::out_of_range("fiz::World::getBody: body was destroyed");
+			return bodies[index];
+		}
+		bool isValid(BodyHandle handle) const
+		{
+			return bodies.isValid(handle);
+		}
 
-		inline glm::vec3 intersectionNormal(Body* a, Body* b)
+		// the last body takes the removed one's index. Not allowed during step
+		void destroyBody(BodyHandle handle)
 		{
-			Sphere* s_a = (Sphere*)a->shapes[0];
-			Sphere* s_b = (Sphere*)b->shapes[0];
-			glm::vec3 dist = b->m_Pos - a->m_Pos;
-			glm::vec3 normal = glm::normalize(dist);
-			float dist2 = dist.x * dist.x + dist.y * dist.y + dist.z * dist.z;
-			float r2 = s_a->rad + s_b->rad;
-			if (dist2 < r2 * r2 && a->m_Pos != b->m_Pos)
+			unsigned int index = bodies.indexOf(handle);
+			if (index == BodyStorage::invalid_index)
+				return;
+
+			unsigned int last = bodies.size() - 1;
+			bodies.remove(index);
+			broadphase->removeBody(index, last);
+		}
+
+		// appends the index of every body whose box overlaps box, from the bounds of the last step and
+		// whatever was moved since through setPosition
+		void queryBounds(const Bounds& box, std::vector<unsigned int>& out) const
+		{
+			for (unsigned int i = 0; i < bodies.size(); ++i)
 			{
-				float len = r2 - std::sqrtf(dist2);
-				normal *= len;
-				return normal;
+				if (bodies.bounds[i].overlaps(box))
+					out.push_back(i);
 			}
-			return glm::vec3(0.0f, 0.0f, 0.0f);
 		}
-		inline void solveCollision(float m1, float m2, glm::vec3& v1, glm::vec3& v2, glm::vec3& normal)
+
+		void step(float dt)
 		{
-			static float friction = 0.0f;
-			static float restitution = 0.0f;
+			purgeDestroyed();
+
+			IntegrationStep integration;
+			integration.dt = dt;
+			integration.gravity = gravity;
+			integration.ground_restitution = 0.9f;
+			integration.ceiling = 30.0f;
+			// judged on how far bodies really moved, the ground clamp leaves resting bodies with a downward velocity
+			integration.sleep_distance = sleep_velocity * dt;
+			pool->parallelFor(bodies.size(), body_grain, [this, &integration](unsigned int begin, unsigned int end)
+			{
+				integrate(bodies, begin, end, integration);
+			});
+
+			// broadphase. Sized like last step's, so the list doesn't grow through the arena.
+			// Sleeping bodies still go through it. Their pairs have to be reported every step: the manifold
+			// cache drops whatever was not reported (prune(0) below), and buildIslands needs those contacts
+			// to wake a sleeping stack as a whole. Their boxes didn't change, so sweep and prune moves none of
+			// their endpoints and the tree reinserts none of their leaves. Only the spatial hash rebuilds them
+			bindArena(pairs, &arena);
+			pairs.reserve(last_pair_count);
+			updateBounds();
+			broadphase->update(bodies.bounds, pairs);
+
+			// narrowphase, once per step. Pairs that are both asleep keep their cached state as it is
+			narrowphase.run(pool, &arena, bodies, pairs, gjk_cache, manifolds);
+
+			buildIslands();
+
+			// solver, only this part is iterated
+			solver.prepare(bodies, contacts, dt);
+			if (solver.mode == SEQUENTIAL_SOLVER)
+			{
+				solver.solveIslands(bodies, iters);
+			}
+			else
+			{
+				solver.warmStart(bodies);
+				for (unsigned int x = 0; x < iters; ++x)
+					solver.solve(bodies);
+			}
+			solver.storeImpulses();
 
-			float fr = 1 - friction;
+			updateSleep();
 
-			normal = normalize(normal);
-			glm::vec3 lat1 = glm::normalize(glm::cross(normal, glm::vec3(0.57f, 0.51f, 0.13f)));
-			glm::vec3 lat2 = glm::normalize(glm::cross(normal, lat1));
-			
-			float m1m2 = m1 + m2;
+			gjk_cache.prune(4);
+			manifolds.prune(0);
 
-			float u1 = glm::dot(normal, v1);
-			float u2 = glm::dot(normal, v2);
-			float l1_1 = glm::dot(lat1, v1);
-			float l2_1 = glm::dot(lat1, v2);
-			float l1_2 = glm::dot(lat2, v1);
-			float l2_2 = glm::dot(lat2, v2);
+			releaseFrameData();
+		}
+	private:
 
-			float v_1 = ((m1 - m2) / m1m2) * u1 + ((m2 * 2) / m1m2) * u2;
-			float v_2 = ((m1 * 2) / m1m2) * u1 + ((m2 - m1) / m1m2) * u2;
+		glm::vec3 gravity;
 
-			v1 = (normal * v_1 * restitution) + (lat1 * l1_1 * fr) + (lat2 * l1_2 * fr);
-			v2 = (normal * v_1 * restitution) + (lat1 * l2_1 * fr) + (lat2 * l2_2 * fr);
-		}
+		Broadphase* broadphase;
 
-		bool gjk(Shape* a, Shape* b)
-		{
-			glm::vec3 A = support(a, b, glm::vec3(1.0f, 1.0f, 1.0f));
+		Narrowphase narrowphase;
+
+		PairCache<GjkCache> gjk_cache;
+		PairCache<Manifold> manifolds;
+
+		ContactSolver solver;
 
-			Simplex s;
-			s.addVertex(A);
+		ThreadPool* pool;
 
-			glm::vec3 D = -A;
+		IslandBuilder islands;
+		unsigned int island_count;
 
-			for (unsigned int i = 0; i < 32; ++i)
+		unsigned int last_pair_count;
+		unsigned int last_contact_count;
+
+		// scratch for purgeDestroyed
+		std::vector<unsigned char> slot_retired;
+		std::vector<unsigned char> wake_islands;
+
+		// bodies per task in the parallel per-body loops
+		static const unsigned int body_grain = 256;
+
+		// forgets the pair cache entries of destroyed bodies before their slots are reused, and wakes whatever
+		// was touching them so nothing stays asleep on a body that is gone
+		void purgeDestroyed()
+		{
+			if (bodies.retired.empty())
+				return;
+
+			slot_retired.assign(bodies.slots.size(), 0);
+			for (unsigned int i = 0; i < bodies.retired.size(); ++i)
+				slot_retired[bodies.retired[i]] = 1;
+
+			wake_islands.assign(island_count, 0);
+			manifolds.removeIf([this](uint64_t key)
 			{
-				A = support(a, b, D);
-				if (glm::dot(A, D) < 0.0f)
+				unsigned int slot_a = (unsigned int)(key >> 32);
+				unsigned int slot_b = (unsigned int)key;
+				if (!slot_retired[slot_a] && !slot_retired[slot_b])
 					return false;
-				s.addVertex(A);
 
-				if (doSimplex(s, D))
-					return true;
+				unsigned int other = slot_retired[slot_a] ? slot_b : slot_a;
+				if (!slot_retired[other])
+				{
+					unsigned int index = bodies.slots[other].index;
+					if (!bodies.awake[index] && bodies.island[index] < island_count)
+						wake_islands[bodies.island[index]] = 1;
+				}
+				return true;
+			});
+			gjk_cache.removeIf([this](uint64_t key)
+			{
+				return slot_retired[(unsigned int)(key >> 32)] || slot_retired[(unsigned int)key];
+			});
+
+			for (unsigned int i = 0; i < bodies.size(); ++i)
+			{
+				if (!bodies.awake[i] && bodies.island[i] < island_count && wake_islands[bodies.island[i]])
+					bodies[i].wake();
 			}
+
+			bodies.recycleSlots();
 		}
-		glm::vec3 support(Shape* a, Shape* b, glm::vec3 axis)
+
+		// nothing may point into the arena once it resets
+		void releaseFrameData()
 		{
-			return a->support(axis) - b->support(-axis);
+			last_pair_count = (unsigned int)pairs.size();
+			last_contact_count = (unsigned int)contacts.size();
+			bindArena(pairs, (FrameArena*)nullptr);
+			bindArena(contacts, (FrameArena*)nullptr);
+			narrowphase.releaseFrameData();
+			islands.releaseFrameData();
+			arena.reset();
 		}
-		bool doSimplex(Simplex& s, glm::vec3& d)
+
+		// only the integrator moves bodies without updating their bounds, and it leaves sleeping ones where
+		// they are. Bodies don't rotate, so moving the cached local box is enough
+		void updateBounds()
 		{
-			switch (s.length)
+			pool->parallelFor(bodies.size(), body_grain, [this](unsigned int begin, unsigned int end)
 			{
-			case 1:
-				return false;
-			case 2:
+				for (unsigned int i = begin; i < end; ++i)
+				{
+					if (bodies.awake[i])
+						bodies.updateBounds(i);
+				}
+			});
+		}
+
+		// links bodies through this step's manifolds and wakes every island with an awake body in it, which
+		// covers new contacts and forces applied to sleeping bodies. Static bodies don't join islands
+		void buildIslands()
+		{
+			islands.reset(bodies.size(), &arena);
+			for (unsigned int m = 0; m < manifolds.size(); ++m)
 			{
-				glm::vec3 ab = s.vertices[1] - s.vertices[0];
-				glm::vec3 ao = -s.vertices[1];
-				d = triple_cross(ab, ao);
-				return false;
+				if (!manifolds.isCurrent(m))
+					continue;
+
+				const Manifold& manifold = manifolds[m].value;
+				if (bodies.inv_mass[manifold.a] > 0.0f && bodies.inv_mass[manifold.b] > 0.0f)
+					islands.link(manifold.a, manifold.b);
 			}
-			case 3:
+			island_count = islands.build(bodies);
+
+			for (unsigned int k = 0; k < island_count; ++k)
 			{
-				glm::vec3 ab = s.vertices[2] - s.vertices[1];
-				glm::vec3 ac = s.vertices[2] - s.vertices[0];
-				glm::vec3 ao = -s.vertices[2];
-				glm::vec3 abc = glm::cross(ab, ac);
-				if (glm::dot(glm::cross(abc, ac), ao) > 0.0f)
-				{
-					if (glm::dot(ac, ao) > 0.0f) // edge AC was closest
-					{
-						s.vertices[1] = s.vertices[2];
-						s.length = 2;
-						d = triple_cross(ac, ao);
-					}
-					else
-					{
-						if (glm::dot(ab, ao) > 0.0f) // edge AB was closest
-						{
-							s.vertices[0] = s.vertices[1]; // [C, B, A] -> [B, A]
-							s.vertices[1] = s.vertices[2];
-							s.length = 2;
-							d = triple_cross(ab, ao);
-						}
-						else
-						{
-							s.vertices[0] = s.vertices[2];
-							s.length = 1;
-							d = ao;
-						}
-					}
-				}
-				else
+				unsigned int begin = islands.island_offsets[k];
+				unsigned int end = islands.island_offsets[k + 1];
+
+				bool awake = false;
+				for (unsigned int i = begin; i < end && !awake; ++i)
+					awake = bodies.awake[islands.island_bodies[i]] != 0;
+				if (!awake)
+					continue;
+
+				for (unsigned int i = begin; i < end; ++i)
 				{
-					if (glm::dot(glm::cross(ab, abc), ao) > 0.0f)
-					{
-						if (glm::dot(ab, ao) > 0.0f) // edge AB was closest
-						{
-							s.vertices[0] = s.vertices[1]; // [C, B, A] -> [B, A]
-							s.vertices[1] = s.vertices[2];
-							s.length = 2;
-							d = triple_cross(ab, ao);
-						}
-						else
-						{
-							s.vertices[0] = s.vertices[2];
-							s.length = 1;
-							d = ao;
-						}
-					}
-					else
-					{
-						if (glm::dot(abc, ao) > 0.0f)
-						{
-							d = abc;
-						}
-						else
-						{
-							glm::vec3 temp = s.vertices[1];
-							s.vertices[1] = s.vertices[2];
-							s.vertices[2] = temp;
-							d = -abc;
-						}
-					}
+					Body body = bodies[islands.island_bodies[i]];
+					if (!body.isAwake())
+						body.wake();
 				}
-				return false;
 			}
-			case 4:
+
+			bindArena(contacts, &arena);
+			contacts.reserve(last_contact_count);
+			for (unsigned int m = 0; m < manifolds.size(); ++m)
 			{
-				// regions: ABCD, ABC, ACD, ADB, AB, AC, AD
-				glm::vec3 ao = -s.vertices[3];
-				glm::vec3 bo = -s.vertices[2];
-				glm::vec3 co = -s.vertices[1];
-				glm::vec3 d_o = -s.vertices[0];
+				if (!manifolds.isCurrent(m))
+					continue;
 
-				
+				Manifold& manifold = manifolds[m].value;
+				if (bodies.awake[manifold.a] || bodies.awake[manifold.b])
+					contacts.push_back(&manifold);
 			}
+		}
+
+		// an island sleeps once its most recently moving body has been still for sleep_time
+		void updateSleep()
+		{
+			for (unsigned int k = 0; k < island_count; ++k)
+			{
+				unsigned int begin = islands.island_offsets[k];
+				unsigned int end = islands.island_offsets[k + 1];
+				if (!bodies.awake[islands.island_bodies[begin]])
+					continue;
+
+				float min_time = sleep_time;
+				for (unsigned int i = begin; i < end; ++i)
+					min_time = glm::min(min_time, bodies.sleep_time[islands.island_bodies[i]]);
+
+				if (min_time >= sleep_time)
+				{
+					for (unsigned int i = begin; i < end; ++i)
+						bodies[islands.island_bodies[i]].sleep();
+				}
 			}
 		}
 	};
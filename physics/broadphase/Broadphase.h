@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+
+#include "../geometry/Bounds.h"
+#include "../util/FrameArena.h"
+
+namespace fiz
+{
+	// indices into World::bodies, always stored with a < b
+	struct BodyPair
+	{
+		unsigned int a;
+		unsigned int b;
+
+		BodyPair() : a(0), b(0) {}
+		BodyPair(unsigned int i, unsigned int j) : a(i < j ? i : j), b(i < j ? j : i) {}
+	};
+
+	enum BroadphaseType
+	{
+		SWEEP_AND_PRUNE_BROADPHASE,
+		DYNAMIC_TREE_BROADPHASE,
+		SPATIAL_HASH_BROADPHASE
+	};
+
+	class Broadphase
+	{
+	public:
+		virtual ~Broadphase() {}
+
+		// bounds[i] is the world space box of body i. Fills pairs with every pair of overlapping boxes
+		virtual void update(const std::vector<Bounds>& bounds, FrameVector<BodyPair>& pairs) = 0;
+
+		// body index was removed and the body at last moved into its place. last may be a body added
+		// since the last update. Broadphases that keep nothing per body can ignore it
+		virtual void removeBody(unsigned int index, unsigned int last) {}
+	};
+}
@@ -0,0 +1,388 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include "Broadphase.h"
+
+namespace fiz
+{
+	// dynamic bounding volume hierarchy. Every body gets a leaf with a box enlarged by margin, and the
+	// leaf is only reinserted once the body's box leaves that fat box. Inserts pick a sibling with a
+	// surface area heuristic and the tree is kept balanced with rotations
+	class DynamicTree : public Broadphase
+	{
+	public:
+		static const int null_node = -1;
+
+		DynamicTree(float margin = 0.1f) : margin(margin), root(null_node), free_list(null_node)
+		{
+
+		}
+
+		// only leaves reinserted after this get the new margin
+		void setMargin(float m)
+		{
+			margin = m;
+		}
+		float getMargin() const
+		{
+			return margin;
+		}
+
+		void update(const std::vector<Bounds>& bounds, FrameVector<BodyPair>& pairs)
+		{
+			pairs.clear();
+
+			while (proxies.size() > bounds.size())
+			{
+				destroyProxy(proxies[proxies.size() - 1]);
+				proxies.pop_back();
+			}
+			while (proxies.size() < bounds.size())
+			{
+				unsigned int body = (unsigned int)proxies.size();
+				proxies.push_back(createProxy(bounds[body], body));
+			}
+
+			for (unsigned int i = 0; i < proxies.size(); ++i)
+			{
+				if (!nodes[proxies[i]].box.contains(bounds[i]))
+					moveProxy(proxies[i], bounds[i]);
+			}
+
+			// every overlap is seen from both bodies, only keep it from the lower index
+			for (unsigned int i = 0; i < proxies.size(); ++i)
+			{
+				const Bounds& box = bounds[i];
+				stack.clear();
+				stack.push_back(root);
+				while (!stack.empty())
+				{
+					int index = stack.back();
+					stack.pop_back();
+					if (index == null_node)
+						continue;
+
+					const Node& node = nodes[index];
+					if (!node.box.overlaps(box))
+						continue;
+
+					if (node.isLeaf())
+					{
+						if (node.body > i && box.overlaps(bounds[node.body]))
+							pairs.emplace_back(i, node.body);
+					}
+					else
+					{
+						stack.push_back(node.child1);
+						stack.push_back(node.child2);
+					}
+				}
+			}
+		}
+
+		void removeBody(unsigned int index, unsigned int last)
+		{
+			// a body the tree hasn't seen yet takes over the leaf, update moves it if it doesn't fit
+			if (last >= proxies.size())
+				return;
+
+			destroyProxy(proxies[index]);
+			if (index != last)
+			{
+				proxies[index] = proxies[last];
+				nodes[proxies[index]].body = index;
+			}
+			proxies.pop_back();
+		}
+
+		int getHeight() const
+		{
+			return root == null_node ? 0 : nodes[root].height;
+		}
+
+	private:
+
+		struct Node
+		{
+			Bounds box;
+			int parent; // next free node while on the free list
+			int child1;
+			int child2;
+			int height; // leaves are 0, free nodes are -1
+			unsigned int body;
+
+			inline bool isLeaf() const { return child1 == null_node; }
+		};
+
+		float margin;
+
+		int root;
+		int free_list;
+
+		std::vector<Node> nodes;
+		std::vector<int> proxies; // leaf node of each body
+		std::vector<int> stack;
+
+		static inline float area(const Bounds& b)
+		{
+			glm::vec3 d = b.max - b.min;
+			return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+		}
+		static inline Bounds combine(const Bounds& a, const Bounds& b)
+		{
+			return Bounds(glm::min(a.min, b.min), glm::max(a.max, b.max));
+		}
+
+		int allocateNode()
+		{
+			if (free_list == null_node)
+			{
+				nodes.emplace_back();
+				free_list = (int)nodes.size() - 1;
+				nodes[free_list].parent = null_node;
+			}
+			int index = free_list;
+			free_list = nodes[index].parent;
+			nodes[index].parent = null_node;
+			nodes[index].child1 = null_node;
+			nodes[index].child2 = null_node;
+			nodes[index].height = 0;
+			nodes[index].body = 0;
+			return index;
+		}
+		void freeNode(int index)
+		{
+			nodes[index].parent = free_list;
+			nodes[index].height = -1;
+			free_list = index;
+		}
+
+		int createProxy(const Bounds& box, unsigned int body)
+		{
+			int leaf = allocateNode();
+			nodes[leaf].box = Bounds(box.min - glm::vec3(margin), box.max + glm::vec3(margin));
+			nodes[leaf].body = body;
+			insertLeaf(leaf);
+			return leaf;
+		}
+		void destroyProxy(int leaf)
+		{
+			removeLeaf(leaf);
+			freeNode(leaf);
+		}
+		void moveProxy(int leaf, const Bounds& box)
+		{
+			removeLeaf(leaf);
+			nodes[leaf].box = Bounds(box.min - glm::vec3(margin), box.max + glm::vec3(margin));
+			insertLeaf(leaf);
+		}
+
+		void insertLeaf(int leaf)
+		{
+			if (root == null_node)
+			{
+				root = leaf;
+				nodes[root].parent = null_node;
+				return;
+			}
+
+			// find the best sibling
+			Bounds leaf_box = nodes[leaf].box;
+			int index = root;
+			while (!nodes[index].isLeaf())
+			{
+				int child1 = nodes[index].child1;
+				int child2 = nodes[index].child2;
+
+				float node_area = area(nodes[index].box);
+				float combined_area = area(combine(nodes[index].box, leaf_box));
+
+				// cost of creating a new parent for this node and the new leaf
+				float cost = 2.0f * combined_area;
+
+				// minimum cost of pushing the leaf further down the tree
+				float inheritance_cost = 2.0f * (combined_area - node_area);
+
+				float cost1 = area(combine(leaf_box, nodes[child1].box)) + inheritance_cost;
+				if (!nodes[child1].isLeaf())
+					cost1 -= area(nodes[child1].box);
+
+				float cost2 = area(combine(leaf_box, nodes[child2].box)) + inheritance_cost;
+				if (!nodes[child2].isLeaf())
+					cost2 -= area(nodes[child2].box);
+
+				if (cost < cost1 && cost < cost2)
+					break;
+
+				index = cost1 < cost2 ? child1 : child2;
+			}
+			int sibling = index;
+
+			// create a new parent
+			int old_parent = nodes[sibling].parent;
+			int new_parent = allocateNode();
+			nodes[new_parent].parent = old_parent;
+			nodes[new_parent].box = combine(leaf_box, nodes[sibling].box);
+			nodes[new_parent].height = nodes[sibling].height + 1;
+			nodes[new_parent].child1 = sibling;
+			nodes[new_parent].child2 = leaf;
+			nodes[sibling].parent = new_parent;
+			nodes[leaf].parent = new_parent;
+
+			if (old_parent != null_node)
+			{
+				if (nodes[old_parent].child1 == sibling)
+					nodes[old_parent].child1 = new_parent;
+				else
+					nodes[old_parent].child2 = new_parent;
+			}
+			else
+			{
+				root = new_parent;
+			}
+
+			refit(nodes[leaf].parent);
+		}
+		void removeLeaf(int leaf)
+		{
+			if (leaf == root)
+			{
+				root = null_node;
+				return;
+			}
+
+			int parent = nodes[leaf].parent;
+			int grand_parent = nodes[parent].parent;
+			int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+			if (grand_parent != null_node)
+			{
+				if (nodes[grand_parent].child1 == parent)
+					nodes[grand_parent].child1 = sibling;
+				else
+					nodes[grand_parent].child2 = sibling;
+				nodes[sibling].parent = grand_parent;
+				freeNode(parent);
+
+				refit(grand_parent);
+			}
+			else
+			{
+				root = sibling;
+				nodes[sibling].parent = null_node;
+				freeNode(parent);
+			}
+		}
+
+		// walks up to the root fixing heights and boxes
+		void refit(int index)
+		{
+			while (index != null_node)
+			{
+				index = balance(index);
+
+				int child1 = nodes[index].child1;
+				int child2 = nodes[index].child2;
+				nodes[index].height = 1 + std::max(nodes[child1].height, nodes[child2].height);
+				nodes[index].box = combine(nodes[child1].box, nodes[child2].box);
+
+				index = nodes[index].parent;
+			}
+		}
+
+		// rotates a if it is imbalanced, returns the new root of the subtree
+		int balance(int a)
+		{
+			if (nodes[a].isLeaf() || nodes[a].height < 2)
+				return a;
+
+			int b = nodes[a].child1;
+			int c = nodes[a].child2;
+			int diff = nodes[c].height - nodes[b].height;
+
+			// rotate c up
+			if (diff > 1)
+			{
+				int f = nodes[c].child1;
+				int g = nodes[c].child2;
+
+				nodes[c].child1 = a;
+				nodes[c].parent = nodes[a].parent;
+				nodes[a].parent = c;
+				replaceChild(nodes[c].parent, a, c);
+
+				if (nodes[f].height > nodes[g].height)
+				{
+					nodes[c].child2 = f;
+					nodes[a].child2 = g;
+					nodes[g].parent = a;
+					nodes[a].box = combine(nodes[b].box, nodes[g].box);
+					nodes[c].box = combine(nodes[a].box, nodes[f].box);
+					nodes[a].height = 1 + std::max(nodes[b].height, nodes[g].height);
+					nodes[c].height = 1 + std::max(nodes[a].height, nodes[f].height);
+				}
+				else
+				{
+					nodes[c].child2 = g;
+					nodes[a].child2 = f;
+					nodes[f].parent = a;
+					nodes[a].box = combine(nodes[b].box, nodes[f].box);
+					nodes[c].box = combine(nodes[a].box, nodes[g].box);
+					nodes[a].height = 1 + std::max(nodes[b].height, nodes[f].height);
+					nodes[c].height = 1 + std::max(nodes[a].height, nodes[g].height);
+				}
+				return c;
+			}
+
+			// rotate b up
+			if (diff < -1)
+			{
+				int d = nodes[b].child1;
+				int e = nodes[b].child2;
+
+				nodes[b].child1 = a;
+				nodes[b].parent = nodes[a].parent;
+				nodes[a].parent = b;
+				replaceChild(nodes[b].parent, a, b);
+
+				if (nodes[d].height > nodes[e].height)
+				{
+					nodes[b].child2 = d;
+					nodes[a].child1 = e;
+					nodes[e].parent = a;
+					nodes[a].box = combine(nodes[c].box, nodes[e].box);
+					nodes[b].box = combine(nodes[a].box, nodes[d].box);
+					nodes[a].height = 1 + std::max(nodes[c].height, nodes[e].height);
+					nodes[b].height = 1 + std::max(nodes[a].height, nodes[d].height);
+				}
+				else
+				{
+					nodes[b].child2 = e;
+					nodes[a].child1 = d;
+					nodes[d].parent = a;
+					nodes[a].box = combine(nodes[c].box, nodes[d].box);
+					nodes[b].box = combine(nodes[a].box, nodes[e].box);
+					nodes[a].height = 1 + std::max(nodes[c].height, nodes[d].height);
+					nodes[b].height = 1 + std::max(nodes[a].height, nodes[e].height);
+				}
+				return b;
+			}
+
+			return a;
+		}
+		void replaceChild(int parent, int old_child, int new_child)
+		{
+			if (parent == null_node)
+			{
+				root = new_child;
+				return;
+			}
+			if (nodes[parent].child1 == old_child)
+				nodes[parent].child1 = new_child;
+			else
+				nodes[parent].child2 = new_child;
+		}
+	};
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "Broadphase.h"
+
+namespace fiz
+{
+	// uniform grid stored in an open addressing hash table, rebuilt from scratch every step. Cell
+	// lists are built with a counting sort into one array. A pair is only reported from the first
+	// cell both bodies share, so bodies spanning several cells don't produce duplicates
+	class SpatialHash : public Broadphase
+	{
+	public:
+		SpatialHash(float cell_size = 2.0f) : cell_size(cell_size)
+		{
+
+		}
+
+		void setCellSize(float size)
+		{
+			cell_size = size;
+		}
+		float getCellSize() const
+		{
+			return cell_size;
+		}
+
+		void update(const std::vector<Bounds>& bounds, FrameVector<BodyPair>& pairs)
+		{
+			pairs.clear();
+
+			float inv_size = 1.0f / cell_size;
+
+			// cell range of every body
+			unsigned int entry_count = 0;
+			ranges.resize(bounds.size());
+			for (unsigned int i = 0; i < bounds.size(); ++i)
+			{
+				CellRange& r = ranges[i];
+				for (unsigned int k = 0; k < 3; ++k)
+				{
+					r.min[k] = (int)std::floor(bounds[i].min[k] * inv_size);
+					r.max[k] = (int)std::floor(bounds[i].max[k] * inv_size);
+				}
+				entry_count += (r.max[0] - r.min[0] + 1) * (r.max[1] - r.min[1] + 1) * (r.max[2] - r.min[2] + 1);
+			}
+
+			unsigned int table_size = 16;
+			while (table_size < entry_count * 2)
+				table_size <<= 1;
+			mask = table_size - 1;
+			table.assign(table_size, Cell());
+
+			// count bodies per cell, remembering the slot of each entry for the second pass
+			entry_slots.resize(entry_count);
+			unsigned int e = 0;
+			for (unsigned int i = 0; i < bounds.size(); ++i)
+			{
+				const CellRange& r = ranges[i];
+				for (int x = r.min[0]; x <= r.max[0]; ++x)
+				{
+					for (int y = r.min[1]; y <= r.max[1]; ++y)
+					{
+						for (int z = r.min[2]; z <= r.max[2]; ++z)
+						{
+							unsigned int slot = findOrInsert(x, y, z);
+							++table[slot].count;
+							entry_slots[e++] = slot;
+						}
+					}
+				}
+			}
+
+			unsigned int start = 0;
+			for (unsigned int i = 0; i < table_size; ++i)
+			{
+				table[i].start = start;
+				start += table[i].count;
+				table[i].count = 0;
+			}
+
+			entries.resize(entry_count);
+			e = 0;
+			for (unsigned int i = 0; i < bounds.size(); ++i)
+			{
+				const CellRange& r = ranges[i];
+				unsigned int cells = (r.max[0] - r.min[0] + 1) * (r.max[1] - r.min[1] + 1) * (r.max[2] - r.min[2] + 1);
+				for (unsigned int c = 0; c < cells; ++c)
+				{
+					Cell& cell = table[entry_slots[e++]];
+					entries[cell.start + cell.count] = i;
+					++cell.count;
+				}
+			}
+
+			for (unsigned int i = 0; i < table_size; ++i)
+			{
+				const Cell& cell = table[i];
+				if (cell.count < 2)
+					continue;
+
+				for (unsigned int j = cell.start + 1; j < cell.start + cell.count; ++j)
+				{
+					unsigned int a = entries[j];
+					for (unsigned int k = cell.start; k < j; ++k)
+					{
+						unsigned int b = entries[k];
+						if (firstSharedCell(ranges[a], ranges[b], cell) && bounds[a].overlaps(bounds[b]))
+							pairs.emplace_back(a, b);
+					}
+				}
+			}
+		}
+
+	private:
+
+		struct CellRange
+		{
+			int min[3];
+			int max[3];
+		};
+		struct Cell
+		{
+			int x;
+			int y;
+			int z;
+			unsigned int start;
+			unsigned int count; // 0 for empty slots
+
+			Cell() : x(0), y(0), z(0), start(0), count(0) {}
+		};
+
+		float cell_size;
+		unsigned int mask;
+
+		std::vector<Cell> table;
+		std::vector<CellRange> ranges;
+		std::vector<unsigned int> entry_slots;
+		std::vector<unsigned int> entries;
+
+		static inline unsigned int hash(int x, int y, int z)
+		{
+			return ((unsigned int)x * 73856093u) ^ ((unsigned int)y * 19349663u) ^ ((unsigned int)z * 83492791u);
+		}
+
+		// linear probing, every inserted cell gets counted right away so count != 0 marks a used slot
+		inline unsigned int findOrInsert(int x, int y, int z)
+		{
+			unsigned int slot = hash(x, y, z) & mask;
+			while (true)
+			{
+				Cell& cell = table[slot];
+				if (cell.count == 0)
+				{
+					cell.x = x;
+					cell.y = y;
+					cell.z = z;
+					return slot;
+				}
+				if (cell.x == x && cell.y == y && cell.z == z)
+					return slot;
+				slot = (slot + 1) & mask;
+			}
+		}
+
+		static inline bool firstSharedCell(const CellRange& a, const CellRange& b, const Cell& cell)
+		{
+			return cell.x == std::max(a.min[0], b.min[0]) &&
+				   cell.y == std::max(a.min[1], b.min[1]) &&
+				   cell.z == std::max(a.min[2], b.min[2]);
+		}
+	};
+}
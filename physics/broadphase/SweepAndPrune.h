@@ -0,0 +1,137 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include "Broadphase.h"
+
+namespace fiz
+{
+	// incremental sweep and prune. Endpoints are kept sorted along one axis and re-sorted with an
+	// insertion sort each step, which is close to linear since bodies barely move between frames.
+	// The remaining two axes are checked with a box test during the sweep
+	class SweepAndPrune : public Broadphase
+	{
+	public:
+		SweepAndPrune(unsigned int axis = 0) : axis(axis), body_count(0)
+		{
+
+		}
+
+		void update(const std::vector<Bounds>& bounds, FrameVector<BodyPair>& pairs)
+		{
+			pairs.clear();
+
+			if (bounds.size() != body_count)
+			{
+				resize((unsigned int)bounds.size());
+				refresh(bounds);
+				std::sort(endpoints.begin(), endpoints.end(), less);
+			}
+			else
+			{
+				refresh(bounds);
+				insertionSort();
+			}
+
+			// sweep, keeping a list of boxes whose interval along the axis is still open
+			active.clear();
+			for (unsigned int i = 0; i < endpoints.size(); ++i)
+			{
+				unsigned int body = endpoints[i].body();
+				if (endpoints[i].isMax())
+				{
+					unsigned int index = active_index[body];
+					unsigned int last = active[active.size() - 1];
+					active[index] = last;
+					active_index[last] = index;
+					active.pop_back();
+				}
+				else
+				{
+					const Bounds& box = bounds[body];
+					for (unsigned int j = 0; j < active.size(); ++j)
+					{
+						if (box.overlaps(bounds[active[j]]))
+							pairs.emplace_back(body, active[j]);
+					}
+					active_index[body] = (unsigned int)active.size();
+					active.push_back(body);
+				}
+			}
+		}
+
+	private:
+
+		struct Endpoint
+		{
+			float value;
+			unsigned int data; // body index << 1 | is max
+
+			Endpoint(unsigned int body, bool is_max) : value(0.0f), data((body << 1) | (is_max ? 1 : 0)) {}
+
+			inline unsigned int body() const { return data >> 1; }
+			inline bool isMax() const { return (data & 1) != 0; }
+		};
+
+		unsigned int axis;
+		unsigned int body_count;
+
+		std::vector<Endpoint> endpoints;
+		std::vector<unsigned int> active;
+		std::vector<unsigned int> active_index;
+
+		// min endpoints go first on ties so touching boxes are reported
+		static inline bool less(const Endpoint& a, const Endpoint& b)
+		{
+			if (a.value != b.value)
+				return a.value < b.value;
+			return (a.data & 1) < (b.data & 1);
+		}
+
+		// removed bodies are replaced by the last one, so the endpoints of index i now belong to whatever
+		// body is at i and only the ones past the new count go
+		void resize(unsigned int count)
+		{
+			if (count < body_count)
+			{
+				endpoints.erase(std::remove_if(endpoints.begin(), endpoints.end(),
+					[count](const Endpoint& e) { return e.body() >= count; }), endpoints.end());
+			}
+			else
+			{
+				for (unsigned int i = body_count; i < count; ++i)
+				{
+					endpoints.emplace_back(i, false);
+					endpoints.emplace_back(i, true);
+				}
+			}
+			body_count = count;
+			active_index.resize(count);
+		}
+
+		void refresh(const std::vector<Bounds>& bounds)
+		{
+			for (unsigned int i = 0; i < endpoints.size(); ++i)
+			{
+				const Bounds& box = bounds[endpoints[i].body()];
+				endpoints[i].value = endpoints[i].isMax() ? box.max[axis] : box.min[axis];
+			}
+		}
+
+		void insertionSort()
+		{
+			for (unsigned int i = 1; i < endpoints.size(); ++i)
+			{
+				Endpoint e = endpoints[i];
+				unsigned int j = i;
+				while (j > 0 && less(e, endpoints[j - 1]))
+				{
+					endpoints[j] = endpoints[j - 1];
+					--j;
+				}
+				endpoints[j] = e;
+			}
+		}
+	};
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <cmath>
+#include <cfloat>
+
+#include <glm/glm.hpp>
+
+#include "../geometry/Shape.h"
+#include "GJK.h"
+#include "EPA.h"
+
+namespace fiz
+{
+	// overlap of two shapes. Moving b by normal * depth separates them
+	struct Penetration
+	{
+		glm::vec3 normal;  // unit vector from a to b
+		float depth;
+		glm::vec3 point_a; // deepest point of a
+		glm::vec3 point_b; // deepest point of b
+	};
+
+	typedef bool (*CollideFn)(Shape* a, glm::vec3 pos_a, Shape* b, glm::vec3 pos_b, Penetration& out, EpaBuffer& buffer, GjkCache* cache);
+
+	inline bool collideSpheres(Shape* a, glm::vec3 pos_a, Shape* b, glm::vec3 pos_b, Penetration& out, EpaBuffer& buffer, GjkCache* cache)
+	{
+		Sphere* s_a = (Sphere*)a;
+		Sphere* s_b = (Sphere*)b;
+		glm::vec3 c_a = pos_a + s_a->pos;
+		glm::vec3 c_b = pos_b + s_b->pos;
+
+		glm::vec3 d = c_b - c_a;
+		float dist2 = glm::dot(d, d);
+		float r = s_a->rad + s_b->rad;
+		if (dist2 > r * r)
+			return false;
+
+		float dist = std::sqrt(dist2);
+		out.normal = dist > 0.0f ? d / dist : glm::vec3(0.0f, 1.0f, 0.0f);
+		out.depth = r - dist;
+		out.point_a = c_a + out.normal * s_a->rad;
+		out.point_b = c_b - out.normal * s_b->rad;
+		return true;
+	}
+
+	inline bool collideSphereAABB(Shape* a, glm::vec3 pos_a, Shape* b, glm::vec3 pos_b, Penetration& out, EpaBuffer& buffer, GjkCache* cache)
+	{
+		Sphere* sphere = (Sphere*)a;
+		AABB* box = (AABB*)b;
+		glm::vec3 c = pos_a + sphere->pos;
+		glm::vec3 min = pos_b + box->min;
+		glm::vec3 max = pos_b + box->max;
+
+		glm::vec3 q = glm::clamp(c, min, max);
+		glm::vec3 d = q - c;
+		float dist2 = glm::dot(d, d);
+		if (dist2 > sphere->rad * sphere->rad)
+			return false;
+
+		if (dist2 > 0.0f)
+		{
+			float dist = std::sqrt(dist2);
+			out.normal = d / dist;
+			out.depth = sphere->rad - dist;
+			out.point_b = q;
+		}
+		else
+		{
+			// centre is inside the box, push out through the nearest face
+			unsigned int axis = 0;
+			float face = c.x - min.x;
+			float sign = 1.0f;
+			for (unsigned int k = 0; k < 3; ++k)
+			{
+				if (c[k] - min[k] < face)
+				{
+					face = c[k] - min[k];
+					axis = k;
+					sign = 1.0f;
+				}
+				if (max[k] - c[k] < face)
+				{
+					face = max[k] - c[k];
+					axis = k;
+					sign = -1.0f;
+				}
+			}
+			out.normal = glm::vec3(0.0f, 0.0f, 0.0f);
+			out.normal[axis] = sign;
+			out.depth = sphere->rad + face;
+			out.point_b = c;
+			out.point_b[axis] = sign > 0.0f ? min[axis] : max[axis];
+		}
+		out.point_a = c + out.normal * sphere->rad;
+		return true;
+	}
+
+	inline bool collideAABBSphere(Shape* a, glm::vec3 pos_a, Shape* b, glm::vec3 pos_b, Penetration& out, EpaBuffer& buffer, GjkCache* cache)
+	{
+		if (!collideSphereAABB(b, pos_b, a, pos_a, out, buffer, cache))
+			return false;
+
+		glm::vec3 temp = out.point_a;
+		out.point_a = out.point_b;
+		out.point_b = temp;
+		out.normal = -out.normal;
+		return true;
+	}
+
+	// separating axis test, boxes only have the three world axes
+	inline bool collideAABBs(Shape* a, glm::vec3 pos_a, Shape* b, glm::vec3 pos_b, Penetration& out, EpaBuffer& buffer, GjkCache* cache)
+	{
+		AABB* box_a = (AABB*)a;
+		AABB* box_b = (AABB*)b;
+		glm::vec3 min_a = pos_a + box_a->min;
+		glm::vec3 max_a = pos_a + box_a->max;
+		glm::vec3 min_b = pos_b + box_b->min;
+		glm::vec3 max_b = pos_b + box_b->max;
+
+		glm::vec3 lo = glm::max(min_a, min_b);
+		glm::vec3 hi = glm::min(max_a, max_b);
+		if (lo.x > hi.x || lo.y > hi.y || lo.z > hi.z)
+			return false;
+
+		// distance b has to move along each axis, in whichever direction is shorter
+		unsigned int axis = 0;
+		float sign = 1.0f;
+		out.depth = FLT_MAX;
+		for (unsigned int k = 0; k < 3; ++k)
+		{
+			float positive = max_a[k] - min_b[k];
+			float negative = max_b[k] - min_a[k];
+			if (positive < out.depth)
+			{
+				out.depth = positive;
+				axis = k;
+				sign = 1.0f;
+			}
+			if (negative < out.depth)
+			{
+				out.depth = negative;
+				axis = k;
+				sign = -1.0f;
+			}
+		}
+
+		out.normal = glm::vec3(0.0f, 0.0f, 0.0f);
+		out.normal[axis] = sign;
+		out.point_a = (lo + hi) * 0.5f;
+		out.point_b = out.point_a;
+		out.point_a[axis] = sign > 0.0f ? max_a[axis] : min_a[axis];
+		out.point_b[axis] = sign > 0.0f ? min_b[axis] : max_b[axis];
+		return true;
+	}
+
+	// general convex fallback. GJK on the cores resolves shallow sphere contacts, EPA the rest
+	inline bool collideConvex(Shape* a, glm::vec3 pos_a, Shape* b, glm::vec3 pos_b, Penetration& out, EpaBuffer& buffer, GjkCache* cache)
+	{
+		GjkResult result;
+		if (!gjk(ConvexProxy(a, pos_a), ConvexProxy(b, pos_b), result, 1e-4f, 32, false, cache))
+			return false;
+
+		// only the sphere radii overlap
+		if (result.termination != GJK_OVERLAP)
+		{
+			out.normal = result.normal;
+			out.depth = -result.distance;
+			out.point_a = result.point_a;
+			out.point_b = result.point_b;
+			return true;
+		}
+
+		// the cores overlap, expand the polytope over the full shapes
+		ConvexProxy full_a(a, pos_a, false);
+		ConvexProxy full_b(b, pos_b, false);
+		Simplex simplex = result.simplex;
+		if (a->shape_type == SPHERE_TYPE || b->shape_type == SPHERE_TYPE)
+		{
+			GjkResult full;
+			gjk(full_a, full_b, full);
+			simplex = full.simplex;
+		}
+
+		EpaResult penetration;
+		if (!epa(full_a, full_b, simplex, buffer, penetration))
+			return false;
+
+		if (cache)
+			cache->axis = penetration.normal;
+
+		out.normal = penetration.normal;
+		out.depth = penetration.depth;
+		out.point_a = penetration.point_a;
+		out.point_b = penetration.point_b;
+		return true;
+	}
+
+	// only these pairs read the GJK cache, the rest are analytic
+	inline bool usesGjk(ShapeType a, ShapeType b)
+	{
+		return a == POLYHEDRON_TYPE || b == POLYHEDRON_TYPE;
+	}
+
+	// picks the routine for a pair of shape types, analytic where there is one
+	inline bool collide(Shape* a, glm::vec3 pos_a, Shape* b, glm::vec3 pos_b, Penetration& out, EpaBuffer& buffer, GjkCache* cache = nullptr)
+	{
+		static const CollideFn table[SHAPE_TYPE_COUNT][SHAPE_TYPE_COUNT] = {
+			// SPHERE_TYPE          AABB_TYPE           POLYHEDRON_TYPE
+			{ collideSpheres,       collideSphereAABB,  collideConvex }, // SPHERE_TYPE
+			{ collideAABBSphere,    collideAABBs,       collideConvex }, // AABB_TYPE
+			{ collideConvex,        collideConvex,      collideConvex }  // POLYHEDRON_TYPE
+		};
+		return table[a->shape_type][b->shape_type](a, pos_a, b, pos_b, out, buffer, cache);
+	}
+}
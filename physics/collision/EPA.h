@@ -0,0 +1,284 @@
+#pragma once
+
+#include <cfloat>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#include "GJK.h"
+
+namespace fiz
+{
+	struct EpaFace
+	{
+		unsigned int v[3]; // counter clockwise seen from outside
+		glm::vec3 normal;  // outward unit normal
+		float dist;        // distance of the face plane from the origin
+	};
+
+	struct EpaEdge
+	{
+		unsigned int a;
+		unsigned int b;
+	};
+
+	// fixed size storage for the expanding polytope so a query never touches the heap. One buffer can
+	// be reused for every pair
+	struct EpaBuffer
+	{
+		static const unsigned int max_vertices = 128;
+		static const unsigned int max_faces = 256;
+		static const unsigned int max_edges = 256;
+
+		SimplexVertex vertices[max_vertices];
+		EpaFace faces[max_faces];
+		EpaEdge edges[max_edges];
+
+		unsigned int vertex_count;
+		unsigned int face_count;
+		unsigned int edge_count;
+
+		EpaBuffer() : vertex_count(0), face_count(0), edge_count(0) {}
+	};
+
+	struct EpaResult
+	{
+		float depth;
+		glm::vec3 normal;  // unit vector from a to b, moving b by normal * depth separates the shapes
+		glm::vec3 point_a; // deepest point of a inside b
+		glm::vec3 point_b; // deepest point of b inside a
+		unsigned int iterations;
+		bool converged;    // false if the buffer filled up or the iteration cap was hit first
+
+		EpaResult() : depth(0.0f), normal(0.0f), point_a(0.0f), point_b(0.0f), iterations(0), converged(false) {}
+	};
+
+	namespace epa_detail
+	{
+		inline bool addFace(EpaBuffer& buffer, unsigned int a, unsigned int b, unsigned int c)
+		{
+			if (buffer.face_count == EpaBuffer::max_faces)
+				return false;
+
+			EpaFace& face = buffer.faces[buffer.face_count++];
+			face.v[0] = a;
+			face.v[1] = b;
+			face.v[2] = c;
+
+			glm::vec3 p = buffer.vertices[a].w;
+			glm::vec3 n = glm::cross(buffer.vertices[b].w - p, buffer.vertices[c].w - p);
+			float len = glm::length(n);
+			if (len > 1e-12f)
+			{
+				face.normal = n / len;
+				face.dist = glm::dot(face.normal, p);
+			}
+			else
+			{
+				// sliver, keep it for the topology but never pick it as the closest face
+				face.normal = glm::vec3(0.0f, 0.0f, 0.0f);
+				face.dist = FLT_MAX;
+			}
+			return true;
+		}
+
+		// an edge shared by two removed faces appears in both directions and cancels out, what is left
+		// is the horizon around the removed region
+		inline bool addEdge(EpaBuffer& buffer, unsigned int a, unsigned int b)
+		{
+			for (unsigned int i = 0; i < buffer.edge_count; ++i)
+			{
+				if (buffer.edges[i].a == b && buffer.edges[i].b == a)
+				{
+					buffer.edges[i] = buffer.edges[--buffer.edge_count];
+					return true;
+				}
+			}
+			if (buffer.edge_count == EpaBuffer::max_edges)
+				return false;
+			buffer.edges[buffer.edge_count].a = a;
+			buffer.edges[buffer.edge_count].b = b;
+			++buffer.edge_count;
+			return true;
+		}
+
+		inline bool isNewVertex(const EpaBuffer& buffer, glm::vec3 w, float epsilon)
+		{
+			for (unsigned int i = 0; i < buffer.vertex_count; ++i)
+			{
+				glm::vec3 d = buffer.vertices[i].w - w;
+				if (glm::dot(d, d) <= epsilon * epsilon)
+					return false;
+			}
+			return true;
+		}
+
+		// grows a simplex that ended on the origin with fewer than 4 vertices into a tetrahedron
+		template<typename Proxy>
+		inline bool buildTetrahedron(const Proxy& a, const Proxy& b, EpaBuffer& buffer, float epsilon)
+		{
+			static const glm::vec3 axes[6] = {
+				glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+				glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+				glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+			};
+
+			if (buffer.vertex_count == 1)
+			{
+				for (unsigned int i = 0; i < 6 && buffer.vertex_count == 1; ++i)
+				{
+					SimplexVertex w = gjkSupport(a, b, axes[i]);
+					if (isNewVertex(buffer, w.w, epsilon))
+						buffer.vertices[buffer.vertex_count++] = w;
+				}
+			}
+			if (buffer.vertex_count == 2)
+			{
+				glm::vec3 d = buffer.vertices[1].w - buffer.vertices[0].w;
+				glm::vec3 e = std::fabs(d.x) < std::fabs(d.y) ?
+					(std::fabs(d.x) < std::fabs(d.z) ? axes[0] : axes[4]) :
+					(std::fabs(d.y) < std::fabs(d.z) ? axes[2] : axes[4]);
+				glm::vec3 n1 = glm::cross(d, e);
+				glm::vec3 n2 = glm::cross(d, n1);
+				glm::vec3 dirs[4] = { n1, -n1, n2, -n2 };
+				for (unsigned int i = 0; i < 4 && buffer.vertex_count == 2; ++i)
+				{
+					SimplexVertex w = gjkSupport(a, b, dirs[i]);
+					glm::vec3 off = glm::cross(d, w.w - buffer.vertices[0].w);
+					if (glm::dot(off, off) > epsilon * epsilon * glm::dot(d, d))
+						buffer.vertices[buffer.vertex_count++] = w;
+				}
+			}
+			if (buffer.vertex_count == 3)
+			{
+				glm::vec3 p = buffer.vertices[0].w;
+				glm::vec3 n = glm::cross(buffer.vertices[1].w - p, buffer.vertices[2].w - p);
+				float len = glm::length(n);
+				if (len <= 0.0f)
+					return false;
+				n /= len;
+				SimplexVertex w = gjkSupport(a, b, n);
+				if (glm::dot(n, w.w - p) <= epsilon)
+					w = gjkSupport(a, b, -n);
+				if (std::fabs(glm::dot(n, w.w - p)) <= epsilon)
+					return false;
+				buffer.vertices[buffer.vertex_count++] = w;
+			}
+			return buffer.vertex_count == 4;
+		}
+
+		inline glm::vec3 barycentric(glm::vec3 p, glm::vec3 a, glm::vec3 b, glm::vec3 c)
+		{
+			glm::vec3 v0 = b - a;
+			glm::vec3 v1 = c - a;
+			glm::vec3 v2 = p - a;
+			float d00 = glm::dot(v0, v0);
+			float d01 = glm::dot(v0, v1);
+			float d11 = glm::dot(v1, v1);
+			float d20 = glm::dot(v2, v0);
+			float d21 = glm::dot(v2, v1);
+			float denom = d00 * d11 - d01 * d01;
+			if (std::fabs(denom) < 1e-12f)
+				return glm::vec3(1.0f, 0.0f, 0.0f);
+			float v = (d11 * d20 - d01 * d21) / denom;
+			float w = (d00 * d21 - d01 * d20) / denom;
+			return glm::vec3(1.0f - v - w, v, w);
+		}
+	}
+
+	// expanding polytope algorithm, seeded with the final simplex of a GJK run that found an overlap.
+	// a and b must be full shapes, not sphere cores, since the polytope has to reach the real surface
+	template<typename Proxy>
+	inline bool epa(const Proxy& a, const Proxy& b, const Simplex& simplex, EpaBuffer& buffer,
+		EpaResult& result, float epsilon = 1e-4f, unsigned int max_iterations = 64)
+	{
+		using namespace epa_detail;
+
+		buffer.vertex_count = 0;
+		buffer.face_count = 0;
+		buffer.edge_count = 0;
+		for (unsigned int i = 0; i < simplex.length; ++i)
+			buffer.vertices[buffer.vertex_count++] = simplex.vertices[i];
+
+		result.converged = false;
+		result.iterations = 0;
+
+		if (buffer.vertex_count == 0 || !buildTetrahedron(a, b, buffer, epsilon))
+			return false;
+
+		SimplexVertex* v = buffer.vertices;
+		if (glm::dot(glm::cross(v[1].w - v[0].w, v[2].w - v[0].w), v[3].w - v[0].w) > 0.0f)
+		{
+			SimplexVertex temp = v[1];
+			v[1] = v[2];
+			v[2] = temp;
+		}
+		addFace(buffer, 0, 1, 2);
+		addFace(buffer, 0, 3, 1);
+		addFace(buffer, 1, 3, 2);
+		addFace(buffer, 0, 2, 3);
+
+		EpaFace closest = buffer.faces[0];
+		for (unsigned int i = 0; i < max_iterations; ++i)
+		{
+			result.iterations = i + 1;
+
+			unsigned int best = 0;
+			for (unsigned int f = 1; f < buffer.face_count; ++f)
+			{
+				if (buffer.faces[f].dist < buffer.faces[best].dist)
+					best = f;
+			}
+			closest = buffer.faces[best];
+			if (closest.dist == FLT_MAX)
+				return false;
+
+			SimplexVertex w = gjkSupport(a, b, closest.normal);
+			if (glm::dot(w.w, closest.normal) - closest.dist < epsilon || !isNewVertex(buffer, w.w, epsilon))
+			{
+				result.converged = true;
+				break;
+			}
+			if (buffer.vertex_count == EpaBuffer::max_vertices)
+				break;
+
+			unsigned int index = buffer.vertex_count++;
+			buffer.vertices[index] = w;
+
+			// remove every face the new point can see and stitch the hole to it
+			bool overflow = false;
+			buffer.edge_count = 0;
+			for (unsigned int f = 0; f < buffer.face_count;)
+			{
+				EpaFace& face = buffer.faces[f];
+				bool visible = face.dist == FLT_MAX ?
+					false : glm::dot(face.normal, w.w - buffer.vertices[face.v[0]].w) > 0.0f;
+				if (visible)
+				{
+					overflow |= !addEdge(buffer, face.v[0], face.v[1]);
+					overflow |= !addEdge(buffer, face.v[1], face.v[2]);
+					overflow |= !addEdge(buffer, face.v[2], face.v[0]);
+					buffer.faces[f] = buffer.faces[--buffer.face_count];
+				}
+				else
+				{
+					++f;
+				}
+			}
+			for (unsigned int e = 0; e < buffer.edge_count; ++e)
+				overflow |= !addFace(buffer, buffer.edges[e].a, buffer.edges[e].b, index);
+
+			if (overflow)
+				break;
+		}
+
+		glm::vec3 p = closest.normal * closest.dist;
+		glm::vec3 bary = barycentric(p, buffer.vertices[closest.v[0]].w, buffer.vertices[closest.v[1]].w, buffer.vertices[closest.v[2]].w);
+
+		result.depth = closest.dist;
+		result.normal = closest.normal;
+		result.point_a = buffer.vertices[closest.v[0]].a * bary.x + buffer.vertices[closest.v[1]].a * bary.y + buffer.vertices[closest.v[2]].a * bary.z;
+		result.point_b = buffer.vertices[closest.v[0]].b * bary.x + buffer.vertices[closest.v[1]].b * bary.y + buffer.vertices[closest.v[2]].b * bary.z;
+		return true;
+	}
+}
@@ -0,0 +1,425 @@
+#pragma once
+
+#include <cfloat>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#include "../geometry/Shape.h"
+
+namespace fiz
+{
+	// a shape placed at a body's position. GJK and EPA take the proxy as a template parameter, anything
+	// with pos, radius and support(axis) works. By default spheres are reduced to their centre point and
+	// inflated by radius afterwards, which keeps GJK exact for them and avoids iterating on a curved
+	// surface. EPA needs the full shape, so the core can be turned off
+	struct ConvexProxy
+	{
+		Shape* shape;
+		glm::vec3 pos;
+		float radius;
+
+		ConvexProxy(Shape* shape, glm::vec3 pos, bool core = true) : shape(shape), pos(pos), radius(0.0f)
+		{
+			if (shape->shape_type == SPHERE_TYPE)
+			{
+				Sphere* sphere = (Sphere*)shape;
+				this->pos += sphere->pos;
+				if (core)
+					radius = sphere->rad;
+			}
+		}
+
+		FIZ_FORCE_INLINE glm::vec3 support(glm::vec3 axis) const
+		{
+			if (shape->shape_type == SPHERE_TYPE)
+			{
+				if (radius > 0.0f)
+					return pos;
+				return pos - ((Sphere*)shape)->pos + ((Sphere*)shape)->support(axis);
+			}
+			return pos + supportOf(shape, axis);
+		}
+	};
+
+	// a point of the minkowski difference a - b along with the points on a and b that made it
+	struct SimplexVertex
+	{
+		glm::vec3 w;
+		glm::vec3 a;
+		glm::vec3 b;
+		float u; // barycentric weight of this vertex in the closest point
+	};
+
+	struct Simplex
+	{
+		SimplexVertex vertices[4];
+		unsigned int length;
+
+		Simplex() : vertices(), length(0) {}
+
+		void addVertex(const SimplexVertex& vertex)
+		{
+			vertices[length] = vertex;
+			++length;
+		}
+
+		glm::vec3 closestPoint() const
+		{
+			glm::vec3 p(0.0f, 0.0f, 0.0f);
+			for (unsigned int i = 0; i < length; ++i)
+				p += vertices[i].w * vertices[i].u;
+			return p;
+		}
+
+		void witnessPoints(glm::vec3& a, glm::vec3& b) const
+		{
+			a = glm::vec3(0.0f, 0.0f, 0.0f);
+			b = glm::vec3(0.0f, 0.0f, 0.0f);
+			for (unsigned int i = 0; i < length; ++i)
+			{
+				a += vertices[i].a * vertices[i].u;
+				b += vertices[i].b * vertices[i].u;
+			}
+		}
+
+		// finds the point of the simplex closest to the origin and drops the vertices that don't
+		// contribute to it. A simplex left with 4 vertices contains the origin
+		void solve()
+		{
+			switch (length)
+			{
+			case 1:
+				vertices[0].u = 1.0f;
+				break;
+			case 2:
+				solve2();
+				break;
+			case 3:
+				solve3();
+				break;
+			case 4:
+				solve4();
+				break;
+			}
+		}
+
+	private:
+
+		void keep(unsigned int i0)
+		{
+			vertices[0] = vertices[i0];
+			vertices[0].u = 1.0f;
+			length = 1;
+		}
+		void keep(unsigned int i0, unsigned int i1, float u0, float u1)
+		{
+			SimplexVertex v1 = vertices[i1];
+			vertices[0] = vertices[i0];
+			vertices[1] = v1;
+			vertices[0].u = u0;
+			vertices[1].u = u1;
+			length = 2;
+		}
+
+		void solve2()
+		{
+			glm::vec3 a = vertices[0].w;
+			glm::vec3 b = vertices[1].w;
+			glm::vec3 ab = b - a;
+
+			float weight_a = glm::dot(b, ab);
+			float weight_b = -glm::dot(a, ab);
+
+			if (weight_b <= 0.0f)
+			{
+				keep(0);
+				return;
+			}
+			if (weight_a <= 0.0f)
+			{
+				keep(1);
+				return;
+			}
+			float inv = 1.0f / (weight_a + weight_b);
+			vertices[0].u = weight_a * inv;
+			vertices[1].u = weight_b * inv;
+		}
+
+		// closest point on triangle to the origin, using the voronoi regions of the triangle
+		void solve3()
+		{
+			glm::vec3 a = vertices[0].w;
+			glm::vec3 b = vertices[1].w;
+			glm::vec3 c = vertices[2].w;
+			glm::vec3 ab = b - a;
+			glm::vec3 ac = c - a;
+
+			float d1 = -glm::dot(ab, a);
+			float d2 = -glm::dot(ac, a);
+			if (d1 <= 0.0f && d2 <= 0.0f)
+			{
+				keep(0);
+				return;
+			}
+
+			float d3 = -glm::dot(ab, b);
+			float d4 = -glm::dot(ac, b);
+			if (d3 >= 0.0f && d4 <= d3)
+			{
+				keep(1);
+				return;
+			}
+
+			float vc = d1 * d4 - d3 * d2;
+			if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+			{
+				float v = d1 / (d1 - d3);
+				keep(0, 1, 1.0f - v, v);
+				return;
+			}
+
+			float d5 = -glm::dot(ab, c);
+			float d6 = -glm::dot(ac, c);
+			if (d6 >= 0.0f && d5 <= d6)
+			{
+				keep(2);
+				return;
+			}
+
+			float vb = d5 * d2 - d1 * d6;
+			if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+			{
+				float w = d2 / (d2 - d6);
+				keep(0, 2, 1.0f - w, w);
+				return;
+			}
+
+			float va = d3 * d6 - d5 * d4;
+			if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+			{
+				float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+				keep(1, 2, 1.0f - w, w);
+				return;
+			}
+
+			float denom = 1.0f / (va + vb + vc);
+			float v = vb * denom;
+			float w = vc * denom;
+			vertices[0].u = 1.0f - v - w;
+			vertices[1].u = v;
+			vertices[2].u = w;
+		}
+
+		// checks every face the origin is in front of and keeps the closest one. If it is behind all
+		// four faces the tetrahedron contains the origin
+		void solve4()
+		{
+			static const unsigned int faces[4][4] = {
+				{ 0, 1, 2, 3 },
+				{ 0, 2, 3, 1 },
+				{ 0, 3, 1, 2 },
+				{ 1, 3, 2, 0 }
+			};
+
+			glm::vec3 a = vertices[0].w;
+			float volume = glm::dot(vertices[3].w - a, glm::cross(vertices[1].w - a, vertices[2].w - a));
+			bool degenerate = std::fabs(volume) < 1e-12f;
+
+			Simplex best;
+			float best_dist2 = FLT_MAX;
+			bool outside = false;
+
+			for (unsigned int f = 0; f < 4; ++f)
+			{
+				glm::vec3 p0 = vertices[faces[f][0]].w;
+				glm::vec3 p1 = vertices[faces[f][1]].w;
+				glm::vec3 p2 = vertices[faces[f][2]].w;
+				glm::vec3 p3 = vertices[faces[f][3]].w;
+				glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+				float side_o = -glm::dot(n, p0);
+				float side_d = glm::dot(n, p3 - p0);
+
+				if (!degenerate && side_o * side_d >= 0.0f)
+					continue;
+
+				outside = true;
+				Simplex face;
+				face.length = 3;
+				face.vertices[0] = vertices[faces[f][0]];
+				face.vertices[1] = vertices[faces[f][1]];
+				face.vertices[2] = vertices[faces[f][2]];
+				face.solve3();
+
+				glm::vec3 p = face.closestPoint();
+				float dist2 = glm::dot(p, p);
+				if (dist2 < best_dist2)
+				{
+					best_dist2 = dist2;
+					best = face;
+				}
+			}
+
+			if (outside)
+			{
+				*this = best;
+				return;
+			}
+
+			// origin is inside, the weights are the barycentric coordinates of the origin
+			glm::vec3 b = vertices[1].w;
+			glm::vec3 c = vertices[2].w;
+			glm::vec3 d = vertices[3].w;
+			float inv = 1.0f / volume;
+			vertices[1].u = glm::dot(d - a, glm::cross(-a, c - a)) * inv;
+			vertices[2].u = glm::dot(d - a, glm::cross(b - a, -a)) * inv;
+			vertices[3].u = glm::dot(-a, glm::cross(b - a, c - a)) * inv;
+			vertices[0].u = 1.0f - vertices[1].u - vertices[2].u - vertices[3].u;
+		}
+	};
+
+	enum GjkTermination
+	{
+		GJK_OVERLAP,        // the simplex enclosed the origin, the core shapes overlap
+		GJK_SEPARATED,      // early out found a separating axis, distance is only a lower bound
+		GJK_CONVERGED,      // the support point did not get closer than epsilon, distance is exact
+		GJK_NO_PROGRESS,    // the simplex stopped shrinking, usually from rounding on near touching shapes
+		GJK_MAX_ITERATIONS
+	};
+
+	struct GjkResult
+	{
+		bool intersecting;
+		float distance;       // separation including sphere radii, negative when only the radii overlap, 0 when the cores overlap
+		glm::vec3 point_a;    // closest point on a
+		glm::vec3 point_b;    // closest point on b
+		glm::vec3 normal;     // unit vector from a to b, zero if the cores overlap
+		unsigned int iterations;
+		GjkTermination termination;
+		Simplex simplex;      // final simplex of the cores
+
+		GjkResult() : intersecting(false), distance(0.0f), point_a(0.0f), point_b(0.0f), normal(0.0f),
+			iterations(0), termination(GJK_MAX_ITERATIONS) {}
+	};
+
+	// kept per body pair between frames. Starting from last frame's axis lets resting pairs converge
+	// in one or two iterations
+	struct GjkCache
+	{
+		glm::vec3 axis; // from a to b
+
+		GjkCache() : axis(1.0f, 1.0f, 1.0f) {}
+	};
+
+	template<typename Proxy>
+	inline SimplexVertex gjkSupport(const Proxy& a, const Proxy& b, glm::vec3 axis)
+	{
+		SimplexVertex v;
+		v.a = a.support(axis);
+		v.b = b.support(-axis);
+		v.w = v.a - v.b;
+		v.u = 1.0f;
+		return v;
+	}
+
+	// distance GJK between two convex proxies. epsilon is an absolute distance tolerance. With early_out
+	// set it stops as soon as the shapes are known to be apart, which is all a boolean test needs. A
+	// cache seeds the first support point and receives the new separating axis
+	template<typename Proxy>
+	inline bool gjk(const Proxy& a, const Proxy& b, GjkResult& result, float epsilon = 1e-4f,
+		unsigned int max_iterations = 32, bool early_out = false, GjkCache* cache = nullptr)
+	{
+		float radius = a.radius + b.radius;
+
+		Simplex& s = result.simplex;
+		s.length = 0;
+		s.addVertex(gjkSupport(a, b, cache ? cache->axis : glm::vec3(1.0f, 1.0f, 1.0f)));
+
+		float last_dist2 = FLT_MAX;
+		result.termination = GJK_MAX_ITERATIONS;
+
+		unsigned int i = 0;
+		for (; i < max_iterations; ++i)
+		{
+			s.solve();
+			if (s.length == 4)
+			{
+				result.termination = GJK_OVERLAP;
+				break;
+			}
+
+			glm::vec3 v = s.closestPoint();
+			float dist2 = glm::dot(v, v);
+			if (dist2 <= epsilon * epsilon)
+			{
+				result.termination = GJK_OVERLAP;
+				break;
+			}
+			if (dist2 >= last_dist2)
+			{
+				result.termination = GJK_NO_PROGRESS;
+				break;
+			}
+			last_dist2 = dist2;
+
+			SimplexVertex w = gjkSupport(a, b, -v);
+			float v_dot_w = glm::dot(v, w.w);
+			float dist = std::sqrt(dist2);
+
+			// v . w / |v| is a lower bound on the distance
+			if (early_out && v_dot_w > (radius + epsilon) * dist)
+			{
+				result.termination = GJK_SEPARATED;
+				break;
+			}
+			if (dist2 - v_dot_w <= epsilon * dist)
+			{
+				result.termination = GJK_CONVERGED;
+				break;
+			}
+
+			bool duplicate = false;
+			for (unsigned int k = 0; k < s.length; ++k)
+			{
+				if (s.vertices[k].w == w.w)
+					duplicate = true;
+			}
+			if (duplicate)
+			{
+				result.termination = GJK_CONVERGED;
+				break;
+			}
+
+			s.addVertex(w);
+		}
+		result.iterations = i;
+
+		if (result.termination == GJK_MAX_ITERATIONS)
+		{
+			s.solve();
+			if (s.length == 4)
+				result.termination = GJK_OVERLAP;
+		}
+
+		s.witnessPoints(result.point_a, result.point_b);
+
+		if (result.termination == GJK_OVERLAP)
+		{
+			result.intersecting = true;
+			result.distance = 0.0f;
+			result.normal = glm::vec3(0.0f, 0.0f, 0.0f);
+			return true;
+		}
+
+		glm::vec3 ab = result.point_b - result.point_a;
+		float core_distance = glm::length(ab);
+		result.normal = core_distance > 0.0f ? ab / core_distance : glm::vec3(0.0f, 0.0f, 0.0f);
+		if (cache && core_distance > 0.0f)
+			cache->axis = result.normal;
+		result.point_a += result.normal * a.radius;
+		result.point_b -= result.normal * b.radius;
+		result.distance = core_distance - radius;
+		result.intersecting = result.distance <= 0.0f;
+		return result.intersecting;
+	}
+}
@@ -0,0 +1,284 @@
+#pragma once
+
+#include <cfloat>
+
+#include <glm/glm.hpp>
+
+#include "../geometry/Shape.h"
+#include "Collide.h"
+
+namespace fiz
+{
+	struct ManifoldPoint
+	{
+		glm::vec3 local_a;  // contact point on a relative to a's position
+		glm::vec3 local_b;  // contact point on b relative to b's position
+		float depth;
+		unsigned int feature_id;
+
+		// accumulated impulses, carried over between frames for warm starting
+		float normal_impulse;
+		float tangent_impulse[2];
+
+		ManifoldPoint() : local_a(0.0f), local_b(0.0f), depth(0.0f), feature_id(0), normal_impulse(0.0f)
+		{
+			tangent_impulse[0] = 0.0f;
+			tangent_impulse[1] = 0.0f;
+		}
+	};
+
+	// up to four contact points between two bodies sharing one normal
+	struct Manifold
+	{
+		static const unsigned int max_points = 4;
+
+		unsigned int a;
+		unsigned int b;
+		glm::vec3 normal; // unit vector from a to b
+		ManifoldPoint points[max_points];
+		unsigned int point_count;
+		unsigned int next_feature; // ids handed out to points of incremental manifolds
+
+		Manifold() : a(0), b(0), normal(0.0f), point_count(0), next_feature(0) {}
+	};
+
+	// distance a point may drift from where it was found before an incremental manifold drops it
+	static const float manifold_threshold = 0.02f;
+
+	namespace manifold_detail
+	{
+		inline ManifoldPoint makePoint(glm::vec3 point_a, glm::vec3 point_b, glm::vec3 pos_a, glm::vec3 pos_b, float depth, unsigned int feature_id)
+		{
+			ManifoldPoint p;
+			p.local_a = point_a - pos_a;
+			p.local_b = point_b - pos_b;
+			p.depth = depth;
+			p.feature_id = feature_id;
+			return p;
+		}
+
+		// corners of the face overlap between two boxes. The feature id records the contact axis and
+		// which box supplied each coordinate of the corner, so it stays the same while boxes slide
+		inline unsigned int boxContacts(AABB* box_a, glm::vec3 pos_a, AABB* box_b, glm::vec3 pos_b, const Penetration& p, ManifoldPoint* out)
+		{
+			glm::vec3 min_a = pos_a + box_a->min;
+			glm::vec3 max_a = pos_a + box_a->max;
+			glm::vec3 min_b = pos_b + box_b->min;
+			glm::vec3 max_b = pos_b + box_b->max;
+
+			unsigned int axis = p.normal.x != 0.0f ? 0 : (p.normal.y != 0.0f ? 1 : 2);
+			unsigned int sign = p.normal[axis] > 0.0f ? 1 : 0;
+			unsigned int u = (axis + 1) % 3;
+			unsigned int v = (axis + 2) % 3;
+
+			float face_a = sign ? max_a[axis] : min_a[axis];
+			float face_b = sign ? min_b[axis] : max_b[axis];
+
+			// each end of the overlap comes from one of the boxes
+			float lo[2] = { glm::max(min_a[u], min_b[u]), glm::max(min_a[v], min_b[v]) };
+			float hi[2] = { glm::min(max_a[u], max_b[u]), glm::min(max_a[v], max_b[v]) };
+			unsigned int lo_from_b[2] = { min_b[u] > min_a[u] ? 1u : 0u, min_b[v] > min_a[v] ? 1u : 0u };
+			unsigned int hi_from_b[2] = { max_b[u] < max_a[u] ? 1u : 0u, max_b[v] < max_a[v] ? 1u : 0u };
+
+			unsigned int count = 0;
+			for (unsigned int corner = 0; corner < 4; ++corner)
+			{
+				unsigned int cu = corner & 1;
+				unsigned int cv = corner >> 1;
+
+				// a zero width overlap collapses two corners into one
+				if (cu && hi[0] - lo[0] <= FLT_EPSILON)
+					continue;
+				if (cv && hi[1] - lo[1] <= FLT_EPSILON)
+					continue;
+
+				glm::vec3 point_a;
+				point_a[axis] = face_a;
+				point_a[u] = cu ? hi[0] : lo[0];
+				point_a[v] = cv ? hi[1] : lo[1];
+				glm::vec3 point_b = point_a;
+				point_b[axis] = face_b;
+
+				unsigned int source_u = cu ? hi_from_b[0] : lo_from_b[0];
+				unsigned int source_v = cv ? hi_from_b[1] : lo_from_b[1];
+				unsigned int feature = axis | (sign << 2) | (corner << 3) | (source_u << 5) | (source_v << 6);
+
+				out[count++] = makePoint(point_a, point_b, pos_a, pos_b, p.depth, feature);
+			}
+			return count;
+		}
+
+		// keeps 4 of 5 points: the deepest, the one farthest from it, then the ones spanning the largest area
+		inline void reduce(ManifoldPoint* points, glm::vec3 normal)
+		{
+			const unsigned int count = Manifold::max_points + 1;
+
+			unsigned int keep[4];
+			keep[0] = 0;
+			for (unsigned int i = 1; i < count; ++i)
+			{
+				if (points[i].depth > points[keep[0]].depth)
+					keep[0] = i;
+			}
+
+			float best = -1.0f;
+			keep[1] = keep[0] == 0 ? 1 : 0;
+			for (unsigned int i = 0; i < count; ++i)
+			{
+				glm::vec3 d = points[i].local_a - points[keep[0]].local_a;
+				if (i != keep[0] && glm::dot(d, d) > best)
+				{
+					best = glm::dot(d, d);
+					keep[1] = i;
+				}
+			}
+
+			best = -1.0f;
+			keep[2] = keep[1];
+			for (unsigned int i = 0; i < count; ++i)
+			{
+				if (i == keep[0] || i == keep[1])
+					continue;
+				float area = std::fabs(glm::dot(glm::cross(points[keep[1]].local_a - points[keep[0]].local_a,
+					points[i].local_a - points[keep[0]].local_a), normal));
+				if (area > best)
+				{
+					best = area;
+					keep[2] = i;
+				}
+			}
+
+			// the last point is the one farthest outside the triangle, measured as the largest added area
+			best = -1.0f;
+			keep[3] = keep[2];
+			for (unsigned int i = 0; i < count; ++i)
+			{
+				if (i == keep[0] || i == keep[1] || i == keep[2])
+					continue;
+				float area = 0.0f;
+				for (unsigned int e = 0; e < 3; ++e)
+				{
+					glm::vec3 p0 = points[keep[e]].local_a;
+					glm::vec3 p1 = points[keep[(e + 1) % 3]].local_a;
+					area = glm::max(area, -glm::dot(glm::cross(p1 - p0, points[i].local_a - p0), normal));
+					area = glm::max(area, glm::dot(glm::cross(p1 - p0, points[i].local_a - p0), normal));
+				}
+				if (area > best)
+				{
+					best = area;
+					keep[3] = i;
+				}
+			}
+
+			ManifoldPoint kept[4];
+			for (unsigned int k = 0; k < 4; ++k)
+				kept[k] = points[keep[k]];
+			for (unsigned int k = 0; k < 4; ++k)
+				points[k] = kept[k];
+		}
+	}
+
+	// fills the manifold of a penetrating pair. Box pairs are rebuilt from scratch each frame and keep
+	// their impulses through feature ids. Other pairs only produce one point per frame, so points from
+	// earlier frames are kept while they stay valid and new points are matched by distance
+	inline void updateManifold(Manifold& manifold, unsigned int a, Shape* shape_a, glm::vec3 pos_a,
+		unsigned int b, Shape* shape_b, glm::vec3 pos_b, const Penetration& p)
+	{
+		using namespace manifold_detail;
+
+		// a flipped or strongly rotated normal makes the old impulses meaningless
+		if (manifold.point_count > 0 && glm::dot(manifold.normal, p.normal) < 0.95f)
+			manifold.point_count = 0;
+
+		manifold.a = a;
+		manifold.b = b;
+		manifold.normal = p.normal;
+
+		if (shape_a->shape_type == AABB_TYPE && shape_b->shape_type == AABB_TYPE)
+		{
+			ManifoldPoint fresh[Manifold::max_points];
+			unsigned int count = boxContacts((AABB*)shape_a, pos_a, (AABB*)shape_b, pos_b, p, fresh);
+			for (unsigned int i = 0; i < count; ++i)
+			{
+				for (unsigned int j = 0; j < manifold.point_count; ++j)
+				{
+					if (manifold.points[j].feature_id == fresh[i].feature_id)
+					{
+						fresh[i].normal_impulse = manifold.points[j].normal_impulse;
+						fresh[i].tangent_impulse[0] = manifold.points[j].tangent_impulse[0];
+						fresh[i].tangent_impulse[1] = manifold.points[j].tangent_impulse[1];
+						break;
+					}
+				}
+			}
+			for (unsigned int i = 0; i < count; ++i)
+				manifold.points[i] = fresh[i];
+			manifold.point_count = count;
+			return;
+		}
+
+		if (shape_a->shape_type == SPHERE_TYPE || shape_b->shape_type == SPHERE_TYPE)
+		{
+			// a sphere only ever touches in one point
+			ManifoldPoint point = makePoint(p.point_a, p.point_b, pos_a, pos_b, p.depth, 0);
+			if (manifold.point_count > 0)
+			{
+				point.normal_impulse = manifold.points[0].normal_impulse;
+				point.tangent_impulse[0] = manifold.points[0].tangent_impulse[0];
+				point.tangent_impulse[1] = manifold.points[0].tangent_impulse[1];
+			}
+			manifold.points[0] = point;
+			manifold.point_count = 1;
+			return;
+		}
+
+		// refresh the points we already have and drop the ones that drifted apart
+		ManifoldPoint points[Manifold::max_points + 1];
+		unsigned int count = 0;
+		for (unsigned int i = 0; i < manifold.point_count; ++i)
+		{
+			ManifoldPoint point = manifold.points[i];
+			glm::vec3 d = (pos_a + point.local_a) - (pos_b + point.local_b);
+			point.depth = glm::dot(d, p.normal);
+			glm::vec3 drift = d - p.normal * point.depth;
+			if (point.depth < -manifold_threshold || glm::dot(drift, drift) > manifold_threshold * manifold_threshold)
+				continue;
+			points[count++] = point;
+		}
+
+		// the new point replaces an old one close to it, or is added
+		ManifoldPoint point = makePoint(p.point_a, p.point_b, pos_a, pos_b, p.depth, 0);
+		unsigned int match = count;
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			glm::vec3 d = points[i].local_a - point.local_a;
+			if (glm::dot(d, d) < manifold_threshold * manifold_threshold)
+			{
+				match = i;
+				break;
+			}
+		}
+		if (match < count)
+		{
+			point.feature_id = points[match].feature_id;
+			point.normal_impulse = points[match].normal_impulse;
+			point.tangent_impulse[0] = points[match].tangent_impulse[0];
+			point.tangent_impulse[1] = points[match].tangent_impulse[1];
+			points[match] = point;
+		}
+		else
+		{
+			point.feature_id = manifold.next_feature++;
+			points[count++] = point;
+		}
+
+		if (count > Manifold::max_points)
+		{
+			reduce(points, p.normal);
+			count = Manifold::max_points;
+		}
+		for (unsigned int i = 0; i < count; ++i)
+			manifold.points[i] = points[i];
+		manifold.point_count = count;
+	}
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "../Body.h"
+#include "../broadphase/Broadphase.h"
+#include "../util/ThreadPool.h"
+#include "../util/FrameArena.h"
+#include "Collide.h"
+#include "PairCache.h"
+#include "Manifold.h"
+
+namespace fiz
+{
+	// runs the pair tests in parallel and applies the results serially. The tests only read the pair caches,
+	// every thread appends its results to its own buffer and the buffers are replayed in pair order, so
+	// manifolds and caches come out the same for any thread count
+	class Narrowphase
+	{
+	public:
+		unsigned int grain; // pairs per chunk
+
+		Narrowphase() : grain(64)
+		{
+
+		}
+
+		// results are kept in arena until releaseFrameData()
+		void run(ThreadPool* pool, FrameArena* arena, BodyStorage& bodies, const FrameVector<BodyPair>& pairs, PairCache<GjkCache>& gjk_cache, PairCache<Manifold>& manifolds)
+		{
+			unsigned int thread_count = pool ? pool->getThreadCount() + 1 : 1;
+			if (buffers.size() != thread_count)
+				buffers.resize(thread_count);
+			for (unsigned int t = 0; t < thread_count; ++t)
+			{
+				bindArena(buffers[t].results, arena);
+				bindArena(buffers[t].chunks, arena);
+			}
+			bindArena(order, arena);
+
+			unsigned int chunk_count = ((unsigned int)pairs.size() + grain - 1) / grain;
+			auto fn = [this, pool, &bodies, &pairs, &gjk_cache](unsigned int begin, unsigned int end)
+			{
+				ThreadBuffer& buffer = buffers[pool ? pool->getThreadIndex() : 0];
+				for (unsigned int chunk = begin; chunk < end; ++chunk)
+					collideChunk(buffer, chunk, bodies, pairs, gjk_cache);
+			};
+			if (pool)
+				pool->parallelFor(chunk_count, 1, fn);
+			else
+				fn(0, chunk_count);
+
+			// chunk i's results, wherever they were written
+			order.resize(chunk_count);
+			for (unsigned int t = 0; t < thread_count; ++t)
+			{
+				for (unsigned int c = 0; c < buffers[t].chunks.size(); ++c)
+				{
+					const Chunk& chunk = buffers[t].chunks[c];
+					order[chunk.index] = ChunkRef{ t, chunk.begin, chunk.end };
+				}
+			}
+
+			for (unsigned int c = 0; c < chunk_count; ++c)
+			{
+				const ThreadBuffer& buffer = buffers[order[c].thread];
+				for (unsigned int r = order[c].begin; r < order[c].end; ++r)
+					apply(buffer.results[r], bodies, gjk_cache, manifolds);
+			}
+		}
+
+		// has to be called before the arena passed to run resets
+		void releaseFrameData()
+		{
+			for (unsigned int t = 0; t < buffers.size(); ++t)
+			{
+				bindArena(buffers[t].results, (FrameArena*)nullptr);
+				bindArena(buffers[t].chunks, (FrameArena*)nullptr);
+			}
+			bindArena(order, (FrameArena*)nullptr);
+		}
+
+	private:
+		enum PairResultType
+		{
+			SLEEPING_PAIR,  // both bodies asleep, only keep the cache entries alive
+			SEPARATED_PAIR, // tested, only the GJK cache changes
+			TOUCHING_PAIR
+		};
+
+		struct PairResult
+		{
+			unsigned int a;
+			unsigned int b;
+			PairResultType type;
+			bool uses_gjk;
+			GjkCache cache;
+			Penetration penetration;
+		};
+
+		struct Chunk
+		{
+			unsigned int index;
+			unsigned int begin; // range in the thread's results
+			unsigned int end;
+		};
+
+		struct ChunkRef
+		{
+			unsigned int thread;
+			unsigned int begin;
+			unsigned int end;
+		};
+
+		struct alignas(64) ThreadBuffer
+		{
+			FrameVector<PairResult> results;
+			FrameVector<Chunk> chunks;
+			EpaBuffer epa_buffer;
+		};
+
+		std::vector<ThreadBuffer> buffers;
+		FrameVector<ChunkRef> order;
+
+		void collideChunk(ThreadBuffer& buffer, unsigned int index, BodyStorage& bodies, const FrameVector<BodyPair>& pairs, const PairCache<GjkCache>& gjk_cache)
+		{
+			Chunk chunk;
+			chunk.index = index;
+			chunk.begin = (unsigned int)buffer.results.size();
+
+			unsigned int end = (index + 1) * grain < pairs.size() ? (index + 1) * grain : (unsigned int)pairs.size();
+			for (unsigned int p = index * grain; p < end; ++p)
+			{
+				unsigned int a = pairs[p].a;
+				unsigned int b = pairs[p].b;
+
+				PairResult result;
+				result.a = a;
+				result.b = b;
+				result.uses_gjk = false;
+
+				if (!bodies.awake[a] && !bodies.awake[b])
+				{
+					result.type = SLEEPING_PAIR;
+					buffer.results.push_back(result);
+					continue;
+				}
+
+				Shape* s_a = bodies.shapes[a][0];
+				Shape* s_b = bodies.shapes[b][0];
+				GjkCache* cache = nullptr;
+				if (usesGjk(s_a->shape_type, s_b->shape_type))
+				{
+					const GjkCache* cached = gjk_cache.peek(PairCache<GjkCache>::key(bodies.slot[a], bodies.slot[b]));
+					result.cache = cached ? *cached : GjkCache();
+					result.uses_gjk = true;
+					cache = &result.cache;
+				}
+
+				bool touching = fiz::collide(s_a, bodies.getPosition(a), s_b, bodies.getPosition(b), result.penetration, buffer.epa_buffer, cache);
+				result.type = touching ? TOUCHING_PAIR : SEPARATED_PAIR;
+				if (touching || result.uses_gjk)
+					buffer.results.push_back(result);
+			}
+
+			chunk.end = (unsigned int)buffer.results.size();
+			buffer.chunks.push_back(chunk);
+		}
+
+		void apply(const PairResult& result, BodyStorage& bodies, PairCache<GjkCache>& gjk_cache, PairCache<Manifold>& manifolds)
+		{
+			uint64_t key = PairCache<Manifold>::key(bodies.slot[result.a], bodies.slot[result.b]);
+			if (result.type == SLEEPING_PAIR)
+			{
+				// a removal may have moved one of the bodies. The old points might be the other way
+				// around now, the pair is tested from scratch once it wakes
+				Manifold* manifold = manifolds.find(key);
+				if (manifold && (manifold->a != result.a || manifold->b != result.b))
+				{
+					manifold->a = result.a;
+					manifold->b = result.b;
+					manifold->point_count = 0;
+				}
+				gjk_cache.find(key);
+				return;
+			}
+
+			bool found;
+			if (result.uses_gjk)
+				gjk_cache.findOrInsert(key, found) = result.cache;
+			if (result.type == SEPARATED_PAIR)
+				return;
+
+			Manifold& manifold = manifolds.findOrInsert(key, found);
+			updateManifold(manifold, result.a, bodies.shapes[result.a][0], bodies.getPosition(result.a),
+				result.b, bodies.shapes[result.b][0], bodies.getPosition(result.b), result.penetration);
+		}
+	};
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+namespace fiz
+{
+	// persistent per body pair storage. Values live in one contiguous array and are found through an
+	// open addressing table of indices. Entries that were not touched for a few frames are pruned
+	template<typename T>
+	class PairCache
+	{
+	public:
+		struct Entry
+		{
+			uint64_t key;
+			unsigned int stamp; // frame the entry was last used
+			T value;
+		};
+
+		static inline uint64_t key(unsigned int a, unsigned int b)
+		{
+			return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+		}
+
+		PairCache() : frame(0), mask(0)
+		{
+
+		}
+
+		T* find(uint64_t key)
+		{
+			if (table.empty())
+				return nullptr;
+
+			unsigned int slot = hash(key) & mask;
+			while (table[slot] != empty)
+			{
+				Entry& entry = entries[table[slot]];
+				if (entry.key == key)
+				{
+					entry.stamp = frame;
+					return &entry.value;
+				}
+				slot = (slot + 1) & mask;
+			}
+			return nullptr;
+		}
+
+		// lookup that leaves the entry's stamp alone, safe from several threads while nothing inserts
+		const T* peek(uint64_t key) const
+		{
+			if (table.empty())
+				return nullptr;
+
+			unsigned int slot = hash(key) & mask;
+			while (table[slot] != empty)
+			{
+				const Entry& entry = entries[table[slot]];
+				if (entry.key == key)
+					return &entry.value;
+				slot = (slot + 1) & mask;
+			}
+			return nullptr;
+		}
+
+		// found is set to false for a new, default constructed value
+		T& findOrInsert(uint64_t key, bool& found)
+		{
+			T* value = find(key);
+			found = value != nullptr;
+			if (found)
+				return *value;
+
+			if ((entries.size() + 1) * 2 > table.size())
+				rehash(table.empty() ? 64 : (unsigned int)table.size() * 2);
+
+			Entry entry;
+			entry.key = key;
+			entry.stamp = frame;
+			entry.value = T();
+			entries.push_back(entry);
+
+			unsigned int slot = hash(key) & mask;
+			while (table[slot] != empty)
+				slot = (slot + 1) & mask;
+			table[slot] = (unsigned int)entries.size() - 1;
+
+			return entries.back().value;
+		}
+
+		// drops entries unused for more than max_age frames and starts a new frame
+		void prune(unsigned int max_age)
+		{
+			unsigned int count = 0;
+			for (unsigned int i = 0; i < entries.size(); ++i)
+			{
+				if (frame - entries[i].stamp <= max_age)
+					entries[count++] = entries[i];
+			}
+			if (count != entries.size())
+			{
+				entries.resize(count);
+				rehash((unsigned int)table.size());
+			}
+			++frame;
+		}
+
+		// drops every entry whose key the predicate returns true for
+		template<typename F>
+		void removeIf(const F& pred)
+		{
+			unsigned int count = 0;
+			for (unsigned int i = 0; i < entries.size(); ++i)
+			{
+				if (!pred(entries[i].key))
+					entries[count++] = entries[i];
+			}
+			if (count != entries.size())
+			{
+				entries.resize(count);
+				rehash((unsigned int)table.size());
+			}
+		}
+
+		void clear()
+		{
+			entries.clear();
+			table.assign(table.size(), empty);
+		}
+
+		unsigned int size() const
+		{
+			return (unsigned int)entries.size();
+		}
+		Entry& operator[](unsigned int i)
+		{
+			return entries[i];
+		}
+
+		// true if entry i was found or inserted during the current frame
+		bool isCurrent(unsigned int i) const
+		{
+			return entries[i].stamp == frame;
+		}
+
+	private:
+		enum : unsigned int { empty = 0xffffffff };
+
+		unsigned int frame;
+		unsigned int mask;
+
+		std::vector<Entry> entries;
+		std::vector<unsigned int> table;
+
+		static inline unsigned int hash(uint64_t key)
+		{
+			key ^= key >> 33;
+			key *= 0xff51afd7ed558ccdull;
+			key ^= key >> 33;
+			return (unsigned int)key;
+		}
+
+		void rehash(unsigned int size)
+		{
+			table.assign(size, empty);
+			mask = size - 1;
+			for (unsigned int i = 0; i < entries.size(); ++i)
+			{
+				unsigned int slot = hash(entries[i].key) & mask;
+				while (table[slot] != empty)
+					slot = (slot + 1) & mask;
+				table[slot] = i;
+			}
+		}
+	};
+}
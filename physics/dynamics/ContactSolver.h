@@ -0,0 +1,591 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "../Body.h"
+#include "../collision/Manifold.h"
+#include "../util/ThreadPool.h"
+#include "../util/Simd.h"
+#include "../util/AlignedAllocator.h"
+
+namespace fiz
+{
+	// one manifold point with everything the solver iterations need, built once per step
+	struct ContactConstraint
+	{
+		unsigned int a;
+		unsigned int b;
+		ManifoldPoint* point; // accumulated impulses are written back here
+
+		glm::vec3 normal;
+		glm::vec3 tangent[2];
+
+		float inv_mass_a;
+		float inv_mass_b;
+		float normal_mass;  // 1 / effective mass along any direction, bodies have no rotation
+		float friction;
+		float bias;         // target separating velocity from penetration and restitution
+
+		float normal_impulse;
+		float tangent_impulse[2];
+	};
+
+	enum SolverMode
+	{
+		SEQUENTIAL_SOLVER,
+		GRAPH_COLORED_SOLVER, // manifolds grouped so no two in a group share a dynamic body, groups solved in parallel
+		SIMD_SOLVER           // constraints packed into register-wide batches of distinct bodies, one batch per SIMD pass
+	};
+
+	// projected Gauss-Seidel sequential impulses. Accumulated impulses are clamped per constraint and
+	// carried between frames in the manifolds so the solver starts close to the previous solution
+	class ContactSolver
+	{
+	public:
+		float baumgarte;             // fraction of the penetration removed per step
+		float slop;                  // penetration left alone to keep contacts warm
+		float restitution_threshold; // slower impacts don't bounce
+
+		SolverMode mode;
+		ThreadPool* pool;   // used by the parallel modes, may be null
+		unsigned int grain; // manifolds per parallel task
+
+		std::vector<ContactConstraint> constraints;
+
+		ContactSolver() : baumgarte(0.2f), slop(0.01f), restitution_threshold(1.0f), mode(SEQUENTIAL_SOLVER), pool(nullptr), grain(64), color_count(0)
+		{
+
+		}
+
+		void prepare(BodyStorage& bodies, const FrameVector<Manifold*>& manifolds, float dt)
+		{
+			constraints.clear();
+			ranges.clear();
+			float inv_dt = dt > 0.0f ? 1.0f / dt : 0.0f;
+
+			for (unsigned int m = 0; m < manifolds.size(); ++m)
+			{
+				Manifold& manifold = *manifolds[m];
+				unsigned int a = manifold.a;
+				unsigned int b = manifold.b;
+
+				float inv_mass_a = bodies.inv_mass[a];
+				float inv_mass_b = bodies.inv_mass[b];
+				float inv_mass = inv_mass_a + inv_mass_b;
+				if (inv_mass == 0.0f)
+					continue;
+
+				glm::vec3 normal = manifold.normal;
+				glm::vec3 t1 = glm::normalize(glm::cross(normal, glm::vec3(0.57f, 0.51f, 0.13f)));
+				glm::vec3 t2 = glm::cross(normal, t1);
+
+				float friction = std::sqrt(bodies.friction[a] * bodies.friction[b]);
+				float restitution = glm::max(bodies.restitution[a], bodies.restitution[b]);
+				float vn = glm::dot(bodies.getVelocity(b) - bodies.getVelocity(a), normal);
+
+				ConstraintRange range;
+				range.begin = (unsigned int)constraints.size();
+				range.end = range.begin + manifold.point_count;
+				ranges.push_back(range);
+
+				for (unsigned int i = 0; i < manifold.point_count; ++i)
+				{
+					ManifoldPoint& point = manifold.points[i];
+
+					ContactConstraint c;
+					c.a = manifold.a;
+					c.b = manifold.b;
+					c.point = &point;
+					c.normal = normal;
+					c.tangent[0] = t1;
+					c.tangent[1] = t2;
+					c.inv_mass_a = inv_mass_a;
+					c.inv_mass_b = inv_mass_b;
+					c.normal_mass = 1.0f / inv_mass;
+					c.friction = friction;
+
+					// points share the linear velocity so they split the load between them
+					c.bias = baumgarte * inv_dt * glm::max(point.depth - slop, 0.0f);
+					if (vn < -restitution_threshold)
+						c.bias = glm::max(c.bias, -restitution * vn);
+
+					c.normal_impulse = point.normal_impulse;
+					c.tangent_impulse[0] = point.tangent_impulse[0];
+					c.tangent_impulse[1] = point.tangent_impulse[1];
+					constraints.push_back(c);
+				}
+			}
+
+			if (mode == GRAPH_COLORED_SOLVER)
+				color(bodies);
+			else if (mode == SIMD_SOLVER)
+				pack();
+			else
+				groupIslands(bodies);
+		}
+
+		void warmStart(BodyStorage& bodies)
+		{
+			if (mode == GRAPH_COLORED_SOLVER)
+			{
+				forEachColor(bodies, &ContactSolver::warmStartRange);
+				return;
+			}
+
+			for (unsigned int i = 0; i < constraints.size(); ++i)
+			{
+				const ContactConstraint& c = constraints[i];
+				glm::vec3 impulse = c.normal * c.normal_impulse + c.tangent[0] * c.tangent_impulse[0] + c.tangent[1] * c.tangent_impulse[1];
+				bodies.setVelocity(c.a, bodies.getVelocity(c.a) - impulse * c.inv_mass_a);
+				bodies.setVelocity(c.b, bodies.getVelocity(c.b) + impulse * c.inv_mass_b);
+			}
+		}
+
+		// one Gauss-Seidel pass over every constraint
+		void solve(BodyStorage& bodies)
+		{
+			if (mode == GRAPH_COLORED_SOLVER)
+			{
+				forEachColor(bodies, &ContactSolver::solveRange);
+				return;
+			}
+			if (mode == SIMD_SOLVER)
+			{
+				for (unsigned int i = 0; i < batches.size(); ++i)
+					solveBatch(bodies, batches[i]);
+				return;
+			}
+
+			for (unsigned int i = 0; i < constraints.size(); ++i)
+			{
+				ContactConstraint& c = constraints[i];
+				glm::vec3 v_a = bodies.getVelocity(c.a);
+				glm::vec3 v_b = bodies.getVelocity(c.b);
+				solveConstraint(c, v_a, v_b);
+				bodies.setVelocity(c.a, v_a);
+				bodies.setVelocity(c.b, v_b);
+			}
+		}
+
+		// sequential mode only. Islands share no dynamic body, so each one runs its warm start and every
+		// iteration as a single task, in the same order the serial solver would use
+		void solveIslands(BodyStorage& bodies, unsigned int iterations)
+		{
+			auto fn = [this, &bodies, iterations](unsigned int begin, unsigned int end)
+			{
+				for (unsigned int k = begin; k < end; ++k)
+				{
+					unsigned int first = island_offsets[k];
+					unsigned int last = island_offsets[k + 1];
+					for (unsigned int i = first; i < last; ++i)
+						warmStartRange(bodies, ranges[island_ranges[i]]);
+					for (unsigned int x = 0; x < iterations; ++x)
+					{
+						for (unsigned int i = first; i < last; ++i)
+							solveRange(bodies, ranges[island_ranges[i]]);
+					}
+				}
+			};
+
+			unsigned int count = island_offsets.empty() ? 0 : (unsigned int)island_offsets.size() - 1;
+			if (pool)
+				pool->parallelFor(count, 4, fn);
+			else
+				fn(0, count);
+		}
+
+		unsigned int getColorCount() const
+		{
+			return color_count;
+		}
+		unsigned int getBatchCount() const
+		{
+			return (unsigned int)batches.size();
+		}
+
+		void storeImpulses()
+		{
+			if (mode == SIMD_SOLVER)
+				unpack();
+
+			for (unsigned int i = 0; i < constraints.size(); ++i)
+			{
+				const ContactConstraint& c = constraints[i];
+				c.point->normal_impulse = c.normal_impulse;
+				c.point->tangent_impulse[0] = c.tangent_impulse[0];
+				c.point->tangent_impulse[1] = c.tangent_impulse[1];
+			}
+		}
+
+		static inline void solveConstraint(ContactConstraint& c, glm::vec3& v_a, glm::vec3& v_b)
+		{
+			// friction first, bounded by last iteration's normal impulse
+			float max_friction = c.friction * c.normal_impulse;
+			for (unsigned int k = 0; k < 2; ++k)
+			{
+				float vt = glm::dot(v_b - v_a, c.tangent[k]);
+				float lambda = -vt * c.normal_mass;
+				float old = c.tangent_impulse[k];
+				c.tangent_impulse[k] = glm::clamp(old + lambda, -max_friction, max_friction);
+				lambda = c.tangent_impulse[k] - old;
+
+				glm::vec3 impulse = c.tangent[k] * lambda;
+				v_a -= impulse * c.inv_mass_a;
+				v_b += impulse * c.inv_mass_b;
+			}
+
+			float vn = glm::dot(v_b - v_a, c.normal);
+			float lambda = (c.bias - vn) * c.normal_mass;
+			float old = c.normal_impulse;
+			c.normal_impulse = glm::max(old + lambda, 0.0f);
+			lambda = c.normal_impulse - old;
+
+			glm::vec3 impulse = c.normal * lambda;
+			v_a -= impulse * c.inv_mass_a;
+			v_b += impulse * c.inv_mass_b;
+		}
+
+	private:
+
+		static const unsigned int lanes = SimdFloat::width;
+
+		// how many of the most recent batches are searched for a free lane before opening a new one
+		static const unsigned int pack_window = 16;
+
+		// constraints transposed so one lane holds one constraint. No two lanes share a dynamic body,
+		// unused lanes have zero mass and are never written back
+		struct alignas(32) ConstraintBatch
+		{
+			float normal[3][lanes];
+			float tangent[2][3][lanes];
+			float inv_mass_a[lanes];
+			float inv_mass_b[lanes];
+			float normal_mass[lanes];
+			float friction[lanes];
+			float bias[lanes];
+			float normal_impulse[lanes];
+			float tangent_impulse[2][lanes];
+
+			unsigned int a[lanes];
+			unsigned int b[lanes];
+			unsigned int constraint[lanes];
+			unsigned int count;
+		};
+
+		std::vector<ConstraintBatch, AlignedAllocator<ConstraintBatch, 32>> batches;
+
+		// one colour per bit, manifolds that find all 64 taken go to a last group solved serially
+		static const unsigned int max_colors = 64;
+
+		// constraints of one manifold, they share both bodies so they are solved together
+		struct ConstraintRange
+		{
+			unsigned int begin;
+			unsigned int end;
+		};
+
+		std::vector<ConstraintRange> ranges;
+		std::vector<unsigned int> range_islands;
+		std::vector<unsigned int> island_ranges;  // range indices sorted by island
+		std::vector<unsigned int> island_offsets; // island k owns island_ranges[offsets[k], offsets[k + 1])
+		std::vector<unsigned int> island_cursor;
+		std::vector<uint64_t> body_colors; // colours already used by each body
+		std::vector<unsigned int> range_colors;
+		std::vector<unsigned int> colored;  // range indices sorted by colour
+		unsigned int color_offsets[max_colors + 2];
+		unsigned int color_count;
+
+		// greedy colouring. Static bodies never get written so they don't constrain the colouring
+		void color(BodyStorage& bodies)
+		{
+			body_colors.assign(bodies.size(), 0);
+			range_colors.resize(ranges.size());
+
+			unsigned int counts[max_colors + 1] = {};
+			color_count = 0;
+			for (unsigned int r = 0; r < ranges.size(); ++r)
+			{
+				const ContactConstraint& c = constraints[ranges[r].begin];
+				uint64_t used = 0;
+				if (c.inv_mass_a > 0.0f)
+					used |= body_colors[c.a];
+				if (c.inv_mass_b > 0.0f)
+					used |= body_colors[c.b];
+
+				unsigned int color = 0;
+				while (color < max_colors && (used & ((uint64_t)1 << color)))
+					++color;
+
+				if (color < max_colors)
+				{
+					if (c.inv_mass_a > 0.0f)
+						body_colors[c.a] |= (uint64_t)1 << color;
+					if (c.inv_mass_b > 0.0f)
+						body_colors[c.b] |= (uint64_t)1 << color;
+					if (color + 1 > color_count)
+						color_count = color + 1;
+				}
+				range_colors[r] = color;
+				++counts[color];
+			}
+
+			color_offsets[0] = 0;
+			for (unsigned int k = 0; k <= max_colors; ++k)
+				color_offsets[k + 1] = color_offsets[k] + counts[k];
+
+			unsigned int cursor[max_colors + 1];
+			for (unsigned int k = 0; k <= max_colors; ++k)
+				cursor[k] = color_offsets[k];
+			colored.resize(ranges.size());
+			for (unsigned int r = 0; r < ranges.size(); ++r)
+				colored[cursor[range_colors[r]]++] = r;
+		}
+
+		// counting sort of the ranges by the island of their dynamic body, keeping their order inside an island.
+		// Relies on bodies.island being up to date for this step's contacts
+		void groupIslands(BodyStorage& bodies)
+		{
+			unsigned int island_count = 0;
+			range_islands.resize(ranges.size());
+			for (unsigned int r = 0; r < ranges.size(); ++r)
+			{
+				const ContactConstraint& c = constraints[ranges[r].begin];
+				unsigned int island = c.inv_mass_a > 0.0f ? bodies.island[c.a] : bodies.island[c.b];
+				range_islands[r] = island;
+				if (island + 1 > island_count)
+					island_count = island + 1;
+			}
+
+			island_offsets.assign(island_count + 1, 0);
+			for (unsigned int r = 0; r < ranges.size(); ++r)
+				++island_offsets[range_islands[r] + 1];
+			for (unsigned int k = 0; k < island_count; ++k)
+				island_offsets[k + 1] += island_offsets[k];
+
+			island_cursor.assign(island_offsets.begin(), island_offsets.end() - 1);
+			island_ranges.resize(ranges.size());
+			for (unsigned int r = 0; r < ranges.size(); ++r)
+				island_ranges[island_cursor[range_islands[r]]++] = r;
+		}
+
+		typedef void (ContactSolver::*RangeFn)(BodyStorage& bodies, const ConstraintRange& range);
+
+		// ranges of one colour touch distinct dynamic bodies, so they run in parallel without locks
+		void forEachColor(BodyStorage& bodies, RangeFn fn)
+		{
+			for (unsigned int k = 0; k <= max_colors; ++k)
+			{
+				unsigned int first = color_offsets[k];
+				unsigned int count = color_offsets[k + 1] - first;
+				if (count == 0)
+					continue;
+
+				if (pool && k < max_colors)
+				{
+					pool->parallelFor(count, grain, [this, &bodies, fn, first](unsigned int begin, unsigned int end)
+					{
+						for (unsigned int i = begin; i < end; ++i)
+							(this->*fn)(bodies, ranges[colored[first + i]]);
+					});
+				}
+				else
+				{
+					for (unsigned int i = 0; i < count; ++i)
+						(this->*fn)(bodies, ranges[colored[first + i]]);
+				}
+			}
+		}
+
+		// static bodies can appear in many ranges of a colour, so only dynamic velocities are written back
+		void solveRange(BodyStorage& bodies, const ConstraintRange& range)
+		{
+			const ContactConstraint& first = constraints[range.begin];
+			glm::vec3 v_a = bodies.getVelocity(first.a);
+			glm::vec3 v_b = bodies.getVelocity(first.b);
+			for (unsigned int i = range.begin; i < range.end; ++i)
+				solveConstraint(constraints[i], v_a, v_b);
+			if (first.inv_mass_a > 0.0f)
+				bodies.setVelocity(first.a, v_a);
+			if (first.inv_mass_b > 0.0f)
+				bodies.setVelocity(first.b, v_b);
+		}
+		void warmStartRange(BodyStorage& bodies, const ConstraintRange& range)
+		{
+			const ContactConstraint& first = constraints[range.begin];
+			glm::vec3 impulse(0.0f, 0.0f, 0.0f);
+			for (unsigned int i = range.begin; i < range.end; ++i)
+			{
+				const ContactConstraint& c = constraints[i];
+				impulse += c.normal * c.normal_impulse + c.tangent[0] * c.tangent_impulse[0] + c.tangent[1] * c.tangent_impulse[1];
+			}
+			if (first.inv_mass_a > 0.0f)
+				bodies.setVelocity(first.a, bodies.getVelocity(first.a) - impulse * first.inv_mass_a);
+			if (first.inv_mass_b > 0.0f)
+				bodies.setVelocity(first.b, bodies.getVelocity(first.b) + impulse * first.inv_mass_b);
+		}
+
+		// greedy first fit over a short window of open batches. Points of one manifold share their bodies
+		// so they always land in different batches, in order
+		void pack()
+		{
+			batches.clear();
+			for (unsigned int i = 0; i < constraints.size(); ++i)
+			{
+				const ContactConstraint& c = constraints[i];
+				unsigned int target = (unsigned int)batches.size();
+				unsigned int first = target > pack_window ? target - pack_window : 0;
+				for (unsigned int k = first; k < batches.size(); ++k)
+				{
+					if (batches[k].count < lanes && fits(batches[k], c))
+					{
+						target = k;
+						break;
+					}
+				}
+
+				if (target == batches.size())
+				{
+					batches.emplace_back();
+					ConstraintBatch& batch = batches.back();
+					batch.count = 0;
+					// padding lanes point at a real body and weigh nothing
+					for (unsigned int l = 0; l < lanes; ++l)
+					{
+						for (unsigned int j = 0; j < 3; ++j)
+						{
+							batch.normal[j][l] = 0.0f;
+							batch.tangent[0][j][l] = 0.0f;
+							batch.tangent[1][j][l] = 0.0f;
+						}
+						batch.inv_mass_a[l] = 0.0f;
+						batch.inv_mass_b[l] = 0.0f;
+						batch.normal_mass[l] = 0.0f;
+						batch.friction[l] = 0.0f;
+						batch.bias[l] = 0.0f;
+						batch.normal_impulse[l] = 0.0f;
+						batch.tangent_impulse[0][l] = 0.0f;
+						batch.tangent_impulse[1][l] = 0.0f;
+						batch.a[l] = c.a;
+						batch.b[l] = c.b;
+						batch.constraint[l] = i;
+					}
+				}
+
+				ConstraintBatch& batch = batches[target];
+				unsigned int l = batch.count++;
+				for (unsigned int j = 0; j < 3; ++j)
+				{
+					batch.normal[j][l] = c.normal[j];
+					batch.tangent[0][j][l] = c.tangent[0][j];
+					batch.tangent[1][j][l] = c.tangent[1][j];
+				}
+				batch.inv_mass_a[l] = c.inv_mass_a;
+				batch.inv_mass_b[l] = c.inv_mass_b;
+				batch.normal_mass[l] = c.normal_mass;
+				batch.friction[l] = c.friction;
+				batch.bias[l] = c.bias;
+				batch.normal_impulse[l] = c.normal_impulse;
+				batch.tangent_impulse[0][l] = c.tangent_impulse[0];
+				batch.tangent_impulse[1][l] = c.tangent_impulse[1];
+				batch.a[l] = c.a;
+				batch.b[l] = c.b;
+				batch.constraint[l] = i;
+			}
+		}
+
+		// a body's mass is the same in every constraint, so comparing ids is enough once the static side is skipped
+		static inline bool fits(const ConstraintBatch& batch, const ContactConstraint& c)
+		{
+			for (unsigned int l = 0; l < batch.count; ++l)
+			{
+				if (c.inv_mass_a > 0.0f && (c.a == batch.a[l] || c.a == batch.b[l]))
+					return false;
+				if (c.inv_mass_b > 0.0f && (c.b == batch.a[l] || c.b == batch.b[l]))
+					return false;
+			}
+			return true;
+		}
+
+		void unpack()
+		{
+			for (unsigned int i = 0; i < batches.size(); ++i)
+			{
+				const ConstraintBatch& batch = batches[i];
+				for (unsigned int l = 0; l < batch.count; ++l)
+				{
+					ContactConstraint& c = constraints[batch.constraint[l]];
+					c.normal_impulse = batch.normal_impulse[l];
+					c.tangent_impulse[0] = batch.tangent_impulse[0][l];
+					c.tangent_impulse[1] = batch.tangent_impulse[1][l];
+				}
+			}
+		}
+
+		// solveConstraint on every lane at once: gather velocities, run the same rows, scatter back
+		void solveBatch(BodyStorage& bodies, ConstraintBatch& batch)
+		{
+			alignas(32) float va[3][lanes];
+			alignas(32) float vb[3][lanes];
+			for (unsigned int l = 0; l < lanes; ++l)
+			{
+				unsigned int a = batch.a[l];
+				unsigned int b = batch.b[l];
+				va[0][l] = bodies.vel_x[a]; va[1][l] = bodies.vel_y[a]; va[2][l] = bodies.vel_z[a];
+				vb[0][l] = bodies.vel_x[b]; vb[1][l] = bodies.vel_y[b]; vb[2][l] = bodies.vel_z[b];
+			}
+
+			SimdFloat vax = SimdFloat::load(va[0]), vay = SimdFloat::load(va[1]), vaz = SimdFloat::load(va[2]);
+			SimdFloat vbx = SimdFloat::load(vb[0]), vby = SimdFloat::load(vb[1]), vbz = SimdFloat::load(vb[2]);
+			SimdFloat inv_mass_a = SimdFloat::load(batch.inv_mass_a);
+			SimdFloat inv_mass_b = SimdFloat::load(batch.inv_mass_b);
+			SimdFloat normal_mass = SimdFloat::load(batch.normal_mass);
+			SimdFloat zero = SimdFloat::set1(0.0f);
+
+			SimdFloat normal_impulse = SimdFloat::load(batch.normal_impulse);
+			SimdFloat max_friction = SimdFloat::load(batch.friction) * normal_impulse;
+			SimdFloat min_friction = zero - max_friction;
+			for (unsigned int k = 0; k < 2; ++k)
+			{
+				SimdFloat tx = SimdFloat::load(batch.tangent[k][0]);
+				SimdFloat ty = SimdFloat::load(batch.tangent[k][1]);
+				SimdFloat tz = SimdFloat::load(batch.tangent[k][2]);
+
+				SimdFloat vt = (vbx - vax) * tx + (vby - vay) * ty + (vbz - vaz) * tz;
+				SimdFloat old = SimdFloat::load(batch.tangent_impulse[k]);
+				SimdFloat impulse = max(min(old - vt * normal_mass, max_friction), min_friction);
+				impulse.store(batch.tangent_impulse[k]);
+				SimdFloat lambda = impulse - old;
+
+				SimdFloat la = lambda * inv_mass_a, lb = lambda * inv_mass_b;
+				vax = vax - tx * la; vay = vay - ty * la; vaz = vaz - tz * la;
+				vbx = vbx + tx * lb; vby = vby + ty * lb; vbz = vbz + tz * lb;
+			}
+
+			SimdFloat nx = SimdFloat::load(batch.normal[0]);
+			SimdFloat ny = SimdFloat::load(batch.normal[1]);
+			SimdFloat nz = SimdFloat::load(batch.normal[2]);
+			SimdFloat vn = (vbx - vax) * nx + (vby - vay) * ny + (vbz - vaz) * nz;
+			SimdFloat impulse = max(normal_impulse + (SimdFloat::load(batch.bias) - vn) * normal_mass, zero);
+			impulse.store(batch.normal_impulse);
+			SimdFloat lambda = impulse - normal_impulse;
+
+			SimdFloat la = lambda * inv_mass_a, lb = lambda * inv_mass_b;
+			vax = vax - nx * la; vay = vay - ny * la; vaz = vaz - nz * la;
+			vbx = vbx + nx * lb; vby = vby + ny * lb; vbz = vbz + nz * lb;
+
+			vax.store(va[0]); vay.store(va[1]); vaz.store(va[2]);
+			vbx.store(vb[0]); vby.store(vb[1]); vbz.store(vb[2]);
+			for (unsigned int l = 0; l < batch.count; ++l)
+			{
+				if (batch.inv_mass_a[l] > 0.0f)
+					bodies.setVelocity(batch.a[l], glm::vec3(va[0][l], va[1][l], va[2][l]));
+				if (batch.inv_mass_b[l] > 0.0f)
+					bodies.setVelocity(batch.b[l], glm::vec3(vb[0][l], vb[1][l], vb[2][l]));
+			}
+		}
+	};
+}
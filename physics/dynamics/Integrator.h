@@ -0,0 +1,246 @@
+#pragma once
+
+#include <cstring>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "../Body.h"
+#include "../util/Simd.h"
+
+namespace fiz
+{
+	struct IntegrationStep
+	{
+		float dt;
+		glm::vec3 gravity;
+		float ground_restitution; // bounce off the ground plane at y = 0
+		float ceiling;            // highest allowed position
+		float sleep_distance;     // bodies moving less than this per step count towards sleeping
+	};
+
+	// semi-implicit Euler with the ground and ceiling clamps, over the SoA body arrays. Every path does the
+	// same operations in the same order, the vector ones replace the clamps' branches with masks
+	namespace integrate_detail
+	{
+		inline void integrateScalar(BodyStorage& bodies, unsigned int begin, unsigned int end, const IntegrationStep& step)
+		{
+			float dt = step.dt;
+			float sleep_distance2 = step.sleep_distance * step.sleep_distance;
+
+			for (unsigned int i = begin; i < end; ++i)
+			{
+				if (!bodies.awake[i])
+					continue;
+
+				// bodies without mass are static to the solver, so gravity leaves them alone too
+				float inv_mass = bodies.inv_mass[i];
+				glm::vec3 g = inv_mass > 0.0f ? step.gravity : glm::vec3(0.0f, 0.0f, 0.0f);
+				float vx = bodies.vel_x[i] + (g.x + bodies.force_x[i] * inv_mass) * dt;
+				float vy = bodies.vel_y[i] + (g.y + bodies.force_y[i] * inv_mass) * dt;
+				float vz = bodies.vel_z[i] + (g.z + bodies.force_z[i] * inv_mass) * dt;
+				float x = bodies.pos_x[i] + vx * dt;
+				float y = bodies.pos_y[i] + vy * dt;
+				float z = bodies.pos_z[i] + vz * dt;
+
+				float lowest = y + bodies.ground_offset[i];
+				if (lowest < 0.0f)
+				{
+					y = y - lowest;
+					vy = vy * -step.ground_restitution;
+				}
+				if (y > step.ceiling)
+				{
+					y = step.ceiling;
+					vy = 0.0f;
+				}
+
+				float dx = x - bodies.pos_x[i];
+				float dy = y - bodies.pos_y[i];
+				float dz = z - bodies.pos_z[i];
+				if (dx * dx + dy * dy + dz * dz > sleep_distance2)
+					bodies.sleep_time[i] = 0.0f;
+				else
+					bodies.sleep_time[i] += dt;
+
+				bodies.pos_x[i] = x; bodies.pos_y[i] = y; bodies.pos_z[i] = z;
+				bodies.vel_x[i] = vx; bodies.vel_y[i] = vy; bodies.vel_z[i] = vz;
+				bodies.force_x[i] = 0.0f; bodies.force_y[i] = 0.0f; bodies.force_z[i] = 0.0f;
+			}
+		}
+
+#if defined(FIZ_SSE2)
+		inline __m128 select(__m128 mask, __m128 a, __m128 b)
+		{
+			return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+		}
+
+		inline void integrateSse2(BodyStorage& bodies, unsigned int begin, unsigned int end, const IntegrationStep& step)
+		{
+			const __m128 dt = _mm_set1_ps(step.dt);
+			const __m128 gx = _mm_set1_ps(step.gravity.x);
+			const __m128 gy = _mm_set1_ps(step.gravity.y);
+			const __m128 gz = _mm_set1_ps(step.gravity.z);
+			const __m128 bounce = _mm_set1_ps(-step.ground_restitution);
+			const __m128 ceiling = _mm_set1_ps(step.ceiling);
+			const __m128 sleep_distance2 = _mm_set1_ps(step.sleep_distance * step.sleep_distance);
+			const __m128 zero = _mm_setzero_ps();
+			const __m128i zero_i = _mm_setzero_si128();
+
+			unsigned int i = begin;
+			for (; i + 4 <= end; i += 4)
+			{
+				// awake flags are bytes, widen four of them to a lane mask
+				int flags;
+				std::memcpy(&flags, &bodies.awake[i], 4);
+				if (flags == 0)
+					continue;
+				__m128i wide = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(flags), zero_i), zero_i);
+				__m128 awake = _mm_castsi128_ps(_mm_cmpgt_epi32(wide, zero_i));
+
+				__m128 inv_mass = _mm_loadu_ps(&bodies.inv_mass[i]);
+				__m128 dynamic = _mm_cmpgt_ps(inv_mass, zero);
+				__m128 px = _mm_loadu_ps(&bodies.pos_x[i]);
+				__m128 py = _mm_loadu_ps(&bodies.pos_y[i]);
+				__m128 pz = _mm_loadu_ps(&bodies.pos_z[i]);
+				__m128 old_vx = _mm_loadu_ps(&bodies.vel_x[i]);
+				__m128 old_vy = _mm_loadu_ps(&bodies.vel_y[i]);
+				__m128 old_vz = _mm_loadu_ps(&bodies.vel_z[i]);
+				__m128 fx = _mm_loadu_ps(&bodies.force_x[i]);
+				__m128 fy = _mm_loadu_ps(&bodies.force_y[i]);
+				__m128 fz = _mm_loadu_ps(&bodies.force_z[i]);
+
+				__m128 vx = _mm_add_ps(old_vx, _mm_mul_ps(_mm_add_ps(_mm_and_ps(dynamic, gx), _mm_mul_ps(fx, inv_mass)), dt));
+				__m128 vy = _mm_add_ps(old_vy, _mm_mul_ps(_mm_add_ps(_mm_and_ps(dynamic, gy), _mm_mul_ps(fy, inv_mass)), dt));
+				__m128 vz = _mm_add_ps(old_vz, _mm_mul_ps(_mm_add_ps(_mm_and_ps(dynamic, gz), _mm_mul_ps(fz, inv_mass)), dt));
+				__m128 x = _mm_add_ps(px, _mm_mul_ps(vx, dt));
+				__m128 y = _mm_add_ps(py, _mm_mul_ps(vy, dt));
+				__m128 z = _mm_add_ps(pz, _mm_mul_ps(vz, dt));
+
+				__m128 lowest = _mm_add_ps(y, _mm_loadu_ps(&bodies.ground_offset[i]));
+				__m128 below = _mm_cmplt_ps(lowest, zero);
+				y = select(below, _mm_sub_ps(y, lowest), y);
+				vy = select(below, _mm_mul_ps(vy, bounce), vy);
+				__m128 above = _mm_cmpgt_ps(y, ceiling);
+				y = select(above, ceiling, y);
+				vy = _mm_andnot_ps(above, vy);
+
+				__m128 dx = _mm_sub_ps(x, px);
+				__m128 dy = _mm_sub_ps(y, py);
+				__m128 dz = _mm_sub_ps(z, pz);
+				__m128 moved2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+				__m128 sleep_time = _mm_andnot_ps(_mm_cmpgt_ps(moved2, sleep_distance2), _mm_add_ps(_mm_loadu_ps(&bodies.sleep_time[i]), dt));
+
+				// sleeping lanes keep everything, like the scalar loop skipping them
+				_mm_storeu_ps(&bodies.pos_x[i], select(awake, x, px));
+				_mm_storeu_ps(&bodies.pos_y[i], select(awake, y, py));
+				_mm_storeu_ps(&bodies.pos_z[i], select(awake, z, pz));
+				_mm_storeu_ps(&bodies.vel_x[i], select(awake, vx, old_vx));
+				_mm_storeu_ps(&bodies.vel_y[i], select(awake, vy, old_vy));
+				_mm_storeu_ps(&bodies.vel_z[i], select(awake, vz, old_vz));
+				_mm_storeu_ps(&bodies.sleep_time[i], select(awake, sleep_time, _mm_loadu_ps(&bodies.sleep_time[i])));
+				_mm_storeu_ps(&bodies.force_x[i], select(awake, zero, fx));
+				_mm_storeu_ps(&bodies.force_y[i], select(awake, zero, fy));
+				_mm_storeu_ps(&bodies.force_z[i], select(awake, zero, fz));
+			}
+
+			integrateScalar(bodies, i, end, step);
+		}
+#endif
+
+#if defined(FIZ_X86)
+		FIZ_TARGET_AVX2 inline void integrateAvx2(BodyStorage& bodies, unsigned int begin, unsigned int end, const IntegrationStep& step)
+		{
+			const __m256 dt = _mm256_set1_ps(step.dt);
+			const __m256 gx = _mm256_set1_ps(step.gravity.x);
+			const __m256 gy = _mm256_set1_ps(step.gravity.y);
+			const __m256 gz = _mm256_set1_ps(step.gravity.z);
+			const __m256 bounce = _mm256_set1_ps(-step.ground_restitution);
+			const __m256 ceiling = _mm256_set1_ps(step.ceiling);
+			const __m256 sleep_distance2 = _mm256_set1_ps(step.sleep_distance * step.sleep_distance);
+			const __m256 zero = _mm256_setzero_ps();
+
+			unsigned int i = begin;
+			for (; i + 8 <= end; i += 8)
+			{
+				uint64_t bits;
+				std::memcpy(&bits, &bodies.awake[i], 8);
+				if (bits == 0)
+					continue;
+				__m128i flags = _mm_loadl_epi64((const __m128i*)&bodies.awake[i]);
+				__m256 awake = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_cvtepu8_epi32(flags), _mm256_setzero_si256()));
+
+				__m256 inv_mass = _mm256_loadu_ps(&bodies.inv_mass[i]);
+				__m256 dynamic = _mm256_cmp_ps(inv_mass, zero, _CMP_GT_OQ);
+				__m256 px = _mm256_loadu_ps(&bodies.pos_x[i]);
+				__m256 py = _mm256_loadu_ps(&bodies.pos_y[i]);
+				__m256 pz = _mm256_loadu_ps(&bodies.pos_z[i]);
+				__m256 old_vx = _mm256_loadu_ps(&bodies.vel_x[i]);
+				__m256 old_vy = _mm256_loadu_ps(&bodies.vel_y[i]);
+				__m256 old_vz = _mm256_loadu_ps(&bodies.vel_z[i]);
+				__m256 fx = _mm256_loadu_ps(&bodies.force_x[i]);
+				__m256 fy = _mm256_loadu_ps(&bodies.force_y[i]);
+				__m256 fz = _mm256_loadu_ps(&bodies.force_z[i]);
+
+				__m256 vx = _mm256_add_ps(old_vx, _mm256_mul_ps(_mm256_add_ps(_mm256_and_ps(dynamic, gx), _mm256_mul_ps(fx, inv_mass)), dt));
+				__m256 vy = _mm256_add_ps(old_vy, _mm256_mul_ps(_mm256_add_ps(_mm256_and_ps(dynamic, gy), _mm256_mul_ps(fy, inv_mass)), dt));
+				__m256 vz = _mm256_add_ps(old_vz, _mm256_mul_ps(_mm256_add_ps(_mm256_and_ps(dynamic, gz), _mm256_mul_ps(fz, inv_mass)), dt));
+				__m256 x = _mm256_add_ps(px, _mm256_mul_ps(vx, dt));
+				__m256 y = _mm256_add_ps(py, _mm256_mul_ps(vy, dt));
+				__m256 z = _mm256_add_ps(pz, _mm256_mul_ps(vz, dt));
+
+				__m256 lowest = _mm256_add_ps(y, _mm256_loadu_ps(&bodies.ground_offset[i]));
+				__m256 below = _mm256_cmp_ps(lowest, zero, _CMP_LT_OQ);
+				y = _mm256_blendv_ps(y, _mm256_sub_ps(y, lowest), below);
+				vy = _mm256_blendv_ps(vy, _mm256_mul_ps(vy, bounce), below);
+				__m256 above = _mm256_cmp_ps(y, ceiling, _CMP_GT_OQ);
+				y = _mm256_blendv_ps(y, ceiling, above);
+				vy = _mm256_andnot_ps(above, vy);
+
+				__m256 dx = _mm256_sub_ps(x, px);
+				__m256 dy = _mm256_sub_ps(y, py);
+				__m256 dz = _mm256_sub_ps(z, pz);
+				__m256 moved2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+				__m256 old_sleep_time = _mm256_loadu_ps(&bodies.sleep_time[i]);
+				__m256 sleep_time = _mm256_andnot_ps(_mm256_cmp_ps(moved2, sleep_distance2, _CMP_GT_OQ), _mm256_add_ps(old_sleep_time, dt));
+
+				// sleeping lanes keep everything, like the scalar loop skipping them
+				_mm256_storeu_ps(&bodies.pos_x[i], _mm256_blendv_ps(px, x, awake));
+				_mm256_storeu_ps(&bodies.pos_y[i], _mm256_blendv_ps(py, y, awake));
+				_mm256_storeu_ps(&bodies.pos_z[i], _mm256_blendv_ps(pz, z, awake));
+				_mm256_storeu_ps(&bodies.vel_x[i], _mm256_blendv_ps(old_vx, vx, awake));
+				_mm256_storeu_ps(&bodies.vel_y[i], _mm256_blendv_ps(old_vy, vy, awake));
+				_mm256_storeu_ps(&bodies.vel_z[i], _mm256_blendv_ps(old_vz, vz, awake));
+				_mm256_storeu_ps(&bodies.sleep_time[i], _mm256_blendv_ps(old_sleep_time, sleep_time, awake));
+				_mm256_storeu_ps(&bodies.force_x[i], _mm256_blendv_ps(fx, zero, awake));
+				_mm256_storeu_ps(&bodies.force_y[i], _mm256_blendv_ps(fy, zero, awake));
+				_mm256_storeu_ps(&bodies.force_z[i], _mm256_blendv_ps(fz, zero, awake));
+			}
+
+			integrateScalar(bodies, i, end, step);
+		}
+#endif
+
+		typedef void (*IntegrateFn)(BodyStorage& bodies, unsigned int begin, unsigned int end, const IntegrationStep& step);
+
+		inline IntegrateFn selectIntegrator()
+		{
+#if defined(FIZ_X86)
+			if (cpuSupportsAvx2())
+				return integrateAvx2;
+#endif
+#if defined(FIZ_SSE2)
+			return integrateSse2;
+#else
+			return integrateScalar;
+#endif
+		}
+	}
+
+	// picks the widest kernel the processor supports the first time it runs
+	inline void integrate(BodyStorage& bodies, unsigned int begin, unsigned int end, const IntegrationStep& step)
+	{
+		static const integrate_detail::IntegrateFn fn = integrate_detail::selectIntegrator();
+		fn(bodies, begin, end, step);
+	}
+}
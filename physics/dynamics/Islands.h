@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+
+#include "../Body.h"
+#include "../util/FrameArena.h"
+
+namespace fiz
+{
+	// union-find over bodies joined by contacts. Rebuilt from scratch every step, islands are numbered
+	// densely once all links are in
+	class IslandBuilder
+	{
+	public:
+		FrameVector<unsigned int> island_bodies;  // body indices grouped by island
+		FrameVector<unsigned int> island_offsets; // island k owns island_bodies[offsets[k], offsets[k + 1])
+
+		// the island lists are allocated from arena until releaseFrameData()
+		void reset(unsigned int body_count, FrameArena* arena = nullptr)
+		{
+			bindArena(island_bodies, arena);
+			bindArena(island_offsets, arena);
+			bindArena(cursor, arena);
+
+			parent.resize(body_count);
+			size.assign(body_count, 1);
+			for (unsigned int i = 0; i < body_count; ++i)
+				parent[i] = i;
+		}
+
+		void link(unsigned int a, unsigned int b)
+		{
+			a = find(a);
+			b = find(b);
+			if (a == b)
+				return;
+
+			if (size[a] < size[b])
+				std::swap(a, b);
+			parent[b] = a;
+			size[a] += size[b];
+		}
+
+		// stores each body's island in bodies.island and groups the bodies, returns the island count
+		unsigned int build(BodyStorage& bodies)
+		{
+			// size is reused as root -> island id
+			static const unsigned int none = 0xffffffff;
+			for (unsigned int i = 0; i < parent.size(); ++i)
+			{
+				if (parent[i] == i)
+					size[i] = none;
+			}
+
+			unsigned int count = 0;
+			for (unsigned int i = 0; i < bodies.size(); ++i)
+			{
+				unsigned int root = find(i);
+				if (size[root] == none)
+					size[root] = count++;
+				bodies.island[i] = size[root];
+			}
+
+			island_offsets.assign(count + 1, 0);
+			for (unsigned int i = 0; i < bodies.size(); ++i)
+				++island_offsets[bodies.island[i] + 1];
+			for (unsigned int k = 0; k < count; ++k)
+				island_offsets[k + 1] += island_offsets[k];
+
+			island_bodies.resize(bodies.size());
+			cursor.assign(island_offsets.begin(), island_offsets.end() - 1);
+			for (unsigned int i = 0; i < bodies.size(); ++i)
+				island_bodies[cursor[bodies.island[i]]++] = i;
+
+			return count;
+		}
+
+		void releaseFrameData()
+		{
+			bindArena(island_bodies, (FrameArena*)nullptr);
+			bindArena(island_offsets, (FrameArena*)nullptr);
+			bindArena(cursor, (FrameArena*)nullptr);
+		}
+
+	private:
+		std::vector<unsigned int> parent;
+		std::vector<unsigned int> size;
+		FrameVector<unsigned int> cursor;
+
+		// path halving
+		inline unsigned int find(unsigned int i)
+		{
+			while (parent[i] != i)
+			{
+				parent[i] = parent[parent[i]];
+				i = parent[i];
+			}
+			return i;
+		}
+	};
+}
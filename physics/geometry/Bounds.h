@@ -0,0 +1,36 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+namespace fiz
+{
+	// axis aligned bounding box, in world space unless noted otherwise
+	struct Bounds
+	{
+		glm::vec3 min;
+		glm::vec3 max;
+
+		Bounds() : min(0.0f, 0.0f, 0.0f), max(0.0f, 0.0f, 0.0f) {}
+		Bounds(glm::vec3 min, glm::vec3 max) : min(min), max(max) {}
+
+		inline bool overlaps(const Bounds& other) const
+		{
+			return min.x <= other.max.x && max.x >= other.min.x &&
+				   min.y <= other.max.y && max.y >= other.min.y &&
+				   min.z <= other.max.z && max.z >= other.min.z;
+		}
+
+		inline bool contains(const Bounds& other) const
+		{
+			return min.x <= other.min.x && max.x >= other.max.x &&
+				   min.y <= other.min.y && max.y >= other.max.y &&
+				   min.z <= other.min.z && max.z >= other.max.z;
+		}
+
+		inline void merge(const Bounds& other)
+		{
+			min = glm::min(min, other.min);
+			max = glm::max(max, other.max);
+		}
+	};
+}
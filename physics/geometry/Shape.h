@@ -1,16 +1,24 @@
 #pragma once
 
 #include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <atomic>
 
 #include <glm/glm.hpp>
 
+#include "SupportSimd.h"
+#include "Bounds.h"
+#include "../util/AlignedAllocator.h"
+
 namespace fiz
 {
 	enum ShapeType
 	{
 		SPHERE_TYPE,
 		AABB_TYPE,
-		POLYHEDRON_TYPE
+		POLYHEDRON_TYPE,
+		SHAPE_TYPE_COUNT
 	};
 
 	class Shape
@@ -22,10 +30,20 @@ namespace fiz
 
 		virtual glm::vec3 support(glm::vec3 axis) { return glm::vec3(0.0f); }
 
+		// support points for count directions at once, out[i] belongs to axes[i]
+		virtual void supportBatch(const glm::vec3* axes, glm::vec3* out, unsigned int count)
+		{
+			for (unsigned int i = 0; i < count; ++i)
+				out[i] = support(axes[i]);
+		}
+
 		virtual float computeVolume() { return 0.0f; }
+
+		// box around the shape relative to its body. Not virtual, it switches on shape_type
+		inline Bounds computeLocalBounds();
 	};
 
-	class Sphere : Shape
+	class Sphere final : Shape
 	{
 	public:
 		glm::vec3 pos;
@@ -43,7 +61,10 @@ namespace fiz
 
 		glm::vec3 support(glm::vec3 axis)
 		{
-			return pos + axis * rad;
+			float len = glm::length(axis);
+			if (len == 0.0f)
+				return pos;
+			return pos + axis * (rad / len);
 		}
 
 		float computeVolume()
@@ -54,7 +75,7 @@ namespace fiz
 		float rad2;
 	};
 
-	class AABB : Shape
+	class AABB final : Shape
 	{
 	public:
 		glm::vec3 min;
@@ -86,20 +107,97 @@ namespace fiz
 		}
 	};
 
-	class Polyhedron : Shape
+	class Polyhedron final : Shape
 	{
 	public:
+		// hulls with at least this many vertices use hill climbing when adjacency is available
+		static const unsigned int hill_climb_threshold = 32;
+		// below this a plain loop beats the SIMD scan
+		static const unsigned int simd_threshold = 8;
+
+		// change vertices through setVertex so the SIMD copy stays in sync
 		std::vector<glm::vec3> vertices;
 
-		Polyhedron(int vertex_count)
+		Polyhedron(int vertex_count) : last_support(0)
 		{
 			shape_type = POLYHEDRON_TYPE;
-			vertices.reserve(vertex_count);
+			vertices.resize(vertex_count);
+			soa_x.resize(simdPadded(vertex_count), 0.0f);
+			soa_y.resize(simdPadded(vertex_count), 0.0f);
+			soa_z.resize(simdPadded(vertex_count), 0.0f);
 		}
 
 		void setVertex(unsigned int index, glm::vec3 vec)
 		{
 			vertices[index] = vec;
+			soa_x[index] = vec.x;
+			soa_y[index] = vec.y;
+			soa_z[index] = vec.z;
+
+			// padding repeats vertex 0 so it can never win over a real vertex
+			if (index == 0)
+			{
+				for (unsigned int i = (unsigned int)vertices.size(); i < soa_x.size(); ++i)
+				{
+					soa_x[i] = vec.x;
+					soa_y[i] = vec.y;
+					soa_z[i] = vec.z;
+				}
+			}
+		}
+
+		// edges as pairs of vertex indices. They must include every edge of the convex hull
+		void setEdges(const std::vector<unsigned int>& edges)
+		{
+			adjacency_offsets.assign(vertices.size() + 1, 0);
+			for (unsigned int i = 0; i < edges.size(); ++i)
+				++adjacency_offsets[edges[i] + 1];
+			for (unsigned int i = 0; i < vertices.size(); ++i)
+				adjacency_offsets[i + 1] += adjacency_offsets[i];
+
+			adjacency.resize(edges.size());
+			std::vector<unsigned int> cursor(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+			for (unsigned int i = 0; i < edges.size(); i += 2)
+			{
+				adjacency[cursor[edges[i]]++] = edges[i + 1];
+				adjacency[cursor[edges[i + 1]]++] = edges[i];
+			}
+			last_support.store(0, std::memory_order_relaxed);
+		}
+
+		// builds the adjacency from the hull triangles, 3 indices per triangle. The triangles are kept for
+		// the volume, they have to be wound the same way
+		void setTriangles(const std::vector<unsigned int>& indices)
+		{
+			triangles = indices;
+
+			std::vector<uint64_t> keys;
+			keys.reserve(indices.size());
+			for (unsigned int i = 0; i + 2 < indices.size(); i += 3)
+			{
+				for (unsigned int k = 0; k < 3; ++k)
+				{
+					uint64_t a = indices[i + k];
+					uint64_t b = indices[i + (k + 1) % 3];
+					keys.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+				}
+			}
+			std::sort(keys.begin(), keys.end());
+			keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+			std::vector<unsigned int> edges;
+			edges.reserve(keys.size() * 2);
+			for (unsigned int i = 0; i < keys.size(); ++i)
+			{
+				edges.push_back((unsigned int)(keys[i] >> 32));
+				edges.push_back((unsigned int)(keys[i] & 0xffffffff));
+			}
+			setEdges(edges);
+		}
+
+		bool hasAdjacency() const
+		{
+			return !adjacency.empty();
 		}
 
 		bool intersects(glm::vec3 point)
@@ -109,6 +207,12 @@ namespace fiz
 
 		glm::vec3 support(glm::vec3 axis)
 		{
+			if (hasAdjacency() && vertices.size() >= hill_climb_threshold)
+				return vertices[hillClimb(axis)];
+
+			if (vertices.size() >= simd_threshold)
+				return vertices[simdIndex(supportIndex(soa_x.data(), soa_y.data(), soa_z.data(), (unsigned int)soa_x.size(), axis))];
+
 			float max_dot = glm::dot(vertices[0], axis);
 			glm::vec3 s = glm::vec3(0.0f, 0.0f, 0.0f);
 			s = vertices[0];
@@ -124,9 +228,153 @@ namespace fiz
 			return s;
 		}
 
+		void supportBatch(const glm::vec3* axes, glm::vec3* out, unsigned int count)
+		{
+			if (vertices.size() < simd_threshold || (hasAdjacency() && vertices.size() >= hill_climb_threshold))
+			{
+				Shape::supportBatch(axes, out, count);
+				return;
+			}
+
+			unsigned int indices[16];
+			for (unsigned int first = 0; first < count; first += 16)
+			{
+				unsigned int group = count - first < 16 ? count - first : 16;
+				supportIndices(soa_x.data(), soa_y.data(), soa_z.data(), (unsigned int)soa_x.size(), axes + first, indices, group);
+				for (unsigned int k = 0; k < group; ++k)
+					out[first + k] = vertices[simdIndex(indices[k])];
+			}
+		}
+
+		// sum of the tetrahedra between the origin and each hull triangle. Without triangles the box around
+		// the vertices stands in, so the body still gets a mass
 		float computeVolume()
 		{
-			return 0.0f;
+			if (vertices.empty())
+				return 0.0f;
+
+			if (triangles.size() < 3)
+			{
+				glm::vec3 min = vertices[0];
+				glm::vec3 max = vertices[0];
+				for (unsigned int i = 1; i < vertices.size(); ++i)
+				{
+					min = glm::min(min, vertices[i]);
+					max = glm::max(max, vertices[i]);
+				}
+				return (max.x - min.x) * (max.y - min.y) * (max.z - min.z);
+			}
+
+			float volume = 0.0f;
+			for (unsigned int i = 0; i + 2 < triangles.size(); i += 3)
+			{
+				glm::vec3 a = vertices[triangles[i]];
+				glm::vec3 b = vertices[triangles[i + 1]];
+				glm::vec3 c = vertices[triangles[i + 2]];
+				volume += glm::dot(a, glm::cross(b, c));
+			}
+			return glm::abs(volume) / 6.0f;
+		}
+
+	private:
+
+		// copy of vertices as separate x, y and z arrays for the SIMD support scan
+		std::vector<float, AlignedAllocator<float, 32>> soa_x;
+		std::vector<float, AlignedAllocator<float, 32>> soa_y;
+		std::vector<float, AlignedAllocator<float, 32>> soa_z;
+
+		// padding lanes are copies of vertex 0
+		inline unsigned int simdIndex(unsigned int index) const
+		{
+			return index < vertices.size() ? index : 0;
+		}
+
+		// compressed adjacency, the neighbours of vertex i are adjacency[adjacency_offsets[i]] up to adjacency_offsets[i + 1]
+		std::vector<unsigned int> adjacency_offsets;
+		std::vector<unsigned int> adjacency;
+		// hull triangles from setTriangles, 3 vertex indices each
+		std::vector<unsigned int> triangles;
+
+		// result of the previous query. Successive GJK directions are close so this is usually a few steps from the answer.
+		// Only a hint, threads sharing the shape may overwrite each other's
+		std::atomic<unsigned int> last_support;
+
+		// walks to a better neighbour until there is none, on a convex hull the local maximum is the global one
+		unsigned int hillClimb(glm::vec3 axis)
+		{
+			unsigned int best = last_support.load(std::memory_order_relaxed);
+			float best_dot = glm::dot(vertices[best], axis);
+
+			bool improved = true;
+			while (improved)
+			{
+				improved = false;
+				unsigned int end = adjacency_offsets[best + 1];
+				for (unsigned int i = adjacency_offsets[best]; i < end; ++i)
+				{
+					unsigned int n = adjacency[i];
+					float dot = glm::dot(vertices[n], axis);
+					if (dot > best_dot)
+					{
+						best = n;
+						best_dot = dot;
+						improved = true;
+						break;
+					}
+				}
+			}
+
+			last_support.store(best, std::memory_order_relaxed);
+			return best;
 		}
 	};
+
+	inline Bounds Shape::computeLocalBounds()
+	{
+		switch (shape_type)
+		{
+		case SPHERE_TYPE:
+		{
+			Sphere* sphere = (Sphere*)this;
+			return Bounds(sphere->pos - glm::vec3(sphere->rad), sphere->pos + glm::vec3(sphere->rad));
+		}
+		case AABB_TYPE:
+		{
+			AABB* box = (AABB*)this;
+			return Bounds(box->min, box->max);
+		}
+		case POLYHEDRON_TYPE:
+		{
+			Polyhedron* poly = (Polyhedron*)this;
+			if (poly->vertices.empty())
+				return Bounds();
+			Bounds b(poly->vertices[0], poly->vertices[0]);
+			for (unsigned int i = 1; i < poly->vertices.size(); ++i)
+			{
+				b.min = glm::min(b.min, poly->vertices[i]);
+				b.max = glm::max(b.max, poly->vertices[i]);
+			}
+			return b;
+		}
+		default:
+			return Bounds();
+		}
+	}
+
+	// support without the virtual call. shape_type already tags every shape and the concrete classes
+	// are final, so each case is a direct call the compiler can inline into GJK and EPA
+	FIZ_FORCE_INLINE glm::vec3 supportOf(Shape* shape, glm::vec3 axis)
+	{
+		switch (shape->shape_type)
+		{
+		case SPHERE_TYPE:
+			return ((Sphere*)shape)->support(axis);
+		case AABB_TYPE:
+			return ((AABB*)shape)->support(axis);
+		case POLYHEDRON_TYPE:
+			return ((Polyhedron*)shape)->support(axis);
+		default:
+			return shape->support(axis);
+		}
+	}
 }
\ No newline at end of file
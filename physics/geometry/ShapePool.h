@@ -0,0 +1,198 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <new>
+
+#include "Shape.h"
+
+namespace fiz
+{
+	// owning reference to a pooled shape. A handle to a destroyed shape is told apart from the shape
+	// that reuses its slot by the generation
+	struct ShapeHandle
+	{
+		ShapeType type;
+		unsigned int index;
+		unsigned int generation;
+
+		ShapeHandle() : type(SHAPE_TYPE_COUNT), index(0xffffffff), generation(0) {}
+		ShapeHandle(ShapeType type, unsigned int index, unsigned int generation) : type(type), index(index), generation(generation) {}
+
+		bool operator==(const ShapeHandle& other) const { return type == other.type && index == other.index && generation == other.generation; }
+		bool operator!=(const ShapeHandle& other) const { return !(*this == other); }
+	};
+
+	// shapes of one type packed into blocks of block_size. Blocks never move, so the Shape pointers
+	// bodies hold stay valid while the slab grows. Freed slots are reused first
+	template<typename T>
+	class ShapeSlab
+	{
+	public:
+		static const unsigned int block_size = 256;
+
+		ShapeSlab() : count(0)
+		{
+
+		}
+		~ShapeSlab()
+		{
+			clear();
+			for (unsigned int i = 0; i < blocks.size(); ++i)
+				delete blocks[i];
+		}
+
+		ShapeSlab(const ShapeSlab&) = delete;
+		ShapeSlab& operator=(const ShapeSlab&) = delete;
+
+		template<typename... Args>
+		unsigned int create(Args&&... args)
+		{
+			unsigned int index;
+			if (!free_slots.empty())
+			{
+				index = free_slots.back();
+				free_slots.pop_back();
+			}
+			else
+			{
+				index = (unsigned int)alive.size();
+				if (index == blocks.size() * block_size)
+					blocks.push_back(new Block());
+				alive.push_back(0);
+				generations.push_back(0);
+			}
+
+			new (at(index)) T(std::forward<Args>(args)...);
+			alive[index] = 1;
+			++count;
+			return index;
+		}
+
+		void destroy(unsigned int index)
+		{
+			at(index)->~T();
+			alive[index] = 0;
+			++generations[index];
+			free_slots.push_back(index);
+			--count;
+		}
+
+		// destroys every shape but keeps the blocks
+		void clear()
+		{
+			for (unsigned int i = 0; i < alive.size(); ++i)
+			{
+				if (alive[i])
+					destroy(i);
+			}
+		}
+
+		T* get(unsigned int index, unsigned int generation)
+		{
+			if (index >= alive.size() || !alive[index] || generations[index] != generation)
+				return nullptr;
+			return at(index);
+		}
+		unsigned int getGeneration(unsigned int index) const
+		{
+			return generations[index];
+		}
+
+		unsigned int size() const
+		{
+			return count;
+		}
+
+	private:
+		struct Block
+		{
+			alignas(T) unsigned char data[sizeof(T) * block_size];
+		};
+
+		std::vector<Block*> blocks;
+		std::vector<unsigned char> alive;
+		std::vector<unsigned int> generations;
+		std::vector<unsigned int> free_slots;
+		unsigned int count;
+
+		inline T* at(unsigned int index)
+		{
+			return (T*)blocks[index / block_size]->data + index % block_size;
+		}
+	};
+
+	// owns every shape of a world, one slab per shape type so collision code working through shapes of
+	// the same kind walks memory in order. Everything left is freed with the pool
+	class ShapePool
+	{
+	public:
+		template<typename T, typename... Args>
+		ShapeHandle create(Args&&... args)
+		{
+			ShapeSlab<T>& s = slab((T*)nullptr);
+			unsigned int index = s.create(std::forward<Args>(args)...);
+			Shape* shape = (Shape*)s.get(index, s.getGeneration(index));
+			return ShapeHandle(shape->shape_type, index, s.getGeneration(index));
+		}
+
+		// nullptr once the shape was destroyed
+		Shape* get(ShapeHandle handle)
+		{
+			switch (handle.type)
+			{
+			case SPHERE_TYPE:
+				return (Shape*)spheres.get(handle.index, handle.generation);
+			case AABB_TYPE:
+				return (Shape*)boxes.get(handle.index, handle.generation);
+			case POLYHEDRON_TYPE:
+				return (Shape*)polyhedra.get(handle.index, handle.generation);
+			default:
+				return nullptr;
+			}
+		}
+
+		// no body may use the shape anymore
+		void destroy(ShapeHandle handle)
+		{
+			if (!get(handle))
+				return;
+
+			switch (handle.type)
+			{
+			case SPHERE_TYPE:
+				spheres.destroy(handle.index);
+				break;
+			case AABB_TYPE:
+				boxes.destroy(handle.index);
+				break;
+			case POLYHEDRON_TYPE:
+				polyhedra.destroy(handle.index);
+				break;
+			default:
+				break;
+			}
+		}
+
+		void clear()
+		{
+			spheres.clear();
+			boxes.clear();
+			polyhedra.clear();
+		}
+
+		unsigned int size() const
+		{
+			return spheres.size() + boxes.size() + polyhedra.size();
+		}
+
+	private:
+		ShapeSlab<Sphere> spheres;
+		ShapeSlab<AABB> boxes;
+		ShapeSlab<Polyhedron> polyhedra;
+
+		ShapeSlab<Sphere>& slab(Sphere*) { return spheres; }
+		ShapeSlab<AABB>& slab(AABB*) { return boxes; }
+		ShapeSlab<Polyhedron>& slab(Polyhedron*) { return polyhedra; }
+	};
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cfloat>
+
+#include <glm/glm.hpp>
+
+#include "../util/Simd.h"
+
+namespace fiz
+{
+	// argmax of dot(vertex, axis) over structure of arrays vertex data. x, y and z are aligned to 32
+	// bytes and padded to simd_width with copies of vertex 0, so the padded count is always scanned
+
+	namespace support_detail
+	{
+		// lane with the largest value, lowest index on ties
+		inline unsigned int reduceArgmax(const float* values, const float* indices, unsigned int lanes)
+		{
+			unsigned int best = 0;
+			for (unsigned int i = 1; i < lanes; ++i)
+			{
+				if (values[i] > values[best] || (values[i] == values[best] && indices[i] < indices[best]))
+					best = i;
+			}
+			return (unsigned int)indices[best];
+		}
+	}
+
+	inline unsigned int supportIndexScalar(const float* x, const float* y, const float* z, unsigned int count, glm::vec3 axis)
+	{
+		unsigned int best = 0;
+		float best_dot = x[0] * axis.x + y[0] * axis.y + z[0] * axis.z;
+		for (unsigned int i = 1; i < count; ++i)
+		{
+			float dot = x[i] * axis.x + y[i] * axis.y + z[i] * axis.z;
+			if (dot > best_dot)
+			{
+				best_dot = dot;
+				best = i;
+			}
+		}
+		return best;
+	}
+
+	inline unsigned int supportIndex(const float* x, const float* y, const float* z, unsigned int padded, glm::vec3 axis)
+	{
+#if defined(FIZ_AVX2)
+		__m256 ax = _mm256_set1_ps(axis.x);
+		__m256 ay = _mm256_set1_ps(axis.y);
+		__m256 az = _mm256_set1_ps(axis.z);
+		__m256 best = _mm256_set1_ps(-FLT_MAX);
+		__m256 best_index = _mm256_setzero_ps();
+		__m256 index = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+		__m256 step = _mm256_set1_ps(8.0f);
+		for (unsigned int i = 0; i < padded; i += 8)
+		{
+			__m256 dot = _mm256_add_ps(_mm256_add_ps(
+				_mm256_mul_ps(_mm256_load_ps(x + i), ax),
+				_mm256_mul_ps(_mm256_load_ps(y + i), ay)),
+				_mm256_mul_ps(_mm256_load_ps(z + i), az));
+			__m256 greater = _mm256_cmp_ps(dot, best, _CMP_GT_OQ);
+			best = _mm256_blendv_ps(best, dot, greater);
+			best_index = _mm256_blendv_ps(best_index, index, greater);
+			index = _mm256_add_ps(index, step);
+		}
+		alignas(32) float values[8];
+		alignas(32) float indices[8];
+		_mm256_store_ps(values, best);
+		_mm256_store_ps(indices, best_index);
+		return support_detail::reduceArgmax(values, indices, 8);
+#elif defined(FIZ_SSE2)
+		__m128 ax = _mm_set1_ps(axis.x);
+		__m128 ay = _mm_set1_ps(axis.y);
+		__m128 az = _mm_set1_ps(axis.z);
+		__m128 best = _mm_set1_ps(-FLT_MAX);
+		__m128 best_index = _mm_setzero_ps();
+		__m128 index = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+		__m128 step = _mm_set1_ps(4.0f);
+		for (unsigned int i = 0; i < padded; i += 4)
+		{
+			__m128 dot = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(_mm_load_ps(x + i), ax),
+				_mm_mul_ps(_mm_load_ps(y + i), ay)),
+				_mm_mul_ps(_mm_load_ps(z + i), az));
+			__m128 greater = _mm_cmpgt_ps(dot, best);
+			best = _mm_or_ps(_mm_and_ps(greater, dot), _mm_andnot_ps(greater, best));
+			best_index = _mm_or_ps(_mm_and_ps(greater, index), _mm_andnot_ps(greater, best_index));
+			index = _mm_add_ps(index, step);
+		}
+		alignas(16) float values[4];
+		alignas(16) float indices[4];
+		_mm_store_ps(values, best);
+		_mm_store_ps(indices, best_index);
+		return support_detail::reduceArgmax(values, indices, 4);
+#else
+		return supportIndexScalar(x, y, z, padded, axis);
+#endif
+	}
+
+	// several directions in one pass over the vertices, out[i] is the support index for axes[i]
+	inline void supportIndices(const float* x, const float* y, const float* z, unsigned int padded,
+		const glm::vec3* axes, unsigned int* out, unsigned int count)
+	{
+#if defined(FIZ_SSE2) || defined(FIZ_AVX2)
+		// four directions per pass keeps everything in registers
+		for (unsigned int first = 0; first < count; first += 4)
+		{
+			unsigned int group = count - first < 4 ? count - first : 4;
+
+			__m128 ax[4], ay[4], az[4], best[4], best_index[4];
+			for (unsigned int k = 0; k < group; ++k)
+			{
+				ax[k] = _mm_set1_ps(axes[first + k].x);
+				ay[k] = _mm_set1_ps(axes[first + k].y);
+				az[k] = _mm_set1_ps(axes[first + k].z);
+				best[k] = _mm_set1_ps(-FLT_MAX);
+				best_index[k] = _mm_setzero_ps();
+			}
+
+			__m128 index = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+			__m128 step = _mm_set1_ps(4.0f);
+			for (unsigned int i = 0; i < padded; i += 4)
+			{
+				__m128 vx = _mm_load_ps(x + i);
+				__m128 vy = _mm_load_ps(y + i);
+				__m128 vz = _mm_load_ps(z + i);
+				for (unsigned int k = 0; k < group; ++k)
+				{
+					__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, ax[k]), _mm_mul_ps(vy, ay[k])), _mm_mul_ps(vz, az[k]));
+					__m128 greater = _mm_cmpgt_ps(dot, best[k]);
+					best[k] = _mm_or_ps(_mm_and_ps(greater, dot), _mm_andnot_ps(greater, best[k]));
+					best_index[k] = _mm_or_ps(_mm_and_ps(greater, index), _mm_andnot_ps(greater, best_index[k]));
+				}
+				index = _mm_add_ps(index, step);
+			}
+
+			for (unsigned int k = 0; k < group; ++k)
+			{
+				alignas(16) float values[4];
+				alignas(16) float indices[4];
+				_mm_store_ps(values, best[k]);
+				_mm_store_ps(indices, best_index[k]);
+				out[first + k] = support_detail::reduceArgmax(values, indices, 4);
+			}
+		}
+#else
+		for (unsigned int k = 0; k < count; ++k)
+			out[k] = supportIndexScalar(x, y, z, padded, axes[k]);
+#endif
+	}
+}
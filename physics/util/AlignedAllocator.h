@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+#include <new>
+
+namespace fiz
+{
+	// std allocator returning memory aligned to Alignment bytes, for arrays read with SIMD loads
+	template<typename T, std::size_t Alignment = 32>
+	class AlignedAllocator
+	{
+	public:
+		typedef T value_type;
+
+		template<typename U>
+		struct rebind
+		{
+			typedef AlignedAllocator<U, Alignment> other;
+		};
+
+		AlignedAllocator() {}
+		template<typename U>
+		AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+		T* allocate(std::size_t n)
+		{
+			// over allocate and keep the original pointer just before the aligned block
+			void* raw = std::malloc(n * sizeof(T) + Alignment + sizeof(void*));
+			if (!raw)
+				throw std::bad_alloc();
+			std::uintptr_t start = (std::uintptr_t)raw + sizeof(void*);
+			std::uintptr_t aligned = (start + Alignment - 1) & ~(std::uintptr_t)(Alignment - 1);
+			((void**)aligned)[-1] = raw;
+			return (T*)aligned;
+		}
+
+		void deallocate(T* p, std::size_t)
+		{
+			if (p)
+				std::free(((void**)p)[-1]);
+		}
+
+		template<typename U>
+		bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+		template<typename U>
+		bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+	};
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+
+namespace fiz
+{
+	// linear allocator for data that only lives for one step. Allocating bumps an offset and is safe
+	// from several threads, nothing is freed until reset(). Once the block is full allocations fall back
+	// to the heap, and the next reset grows the block to fit, so after a few steps nothing touches the heap
+	class FrameArena
+	{
+	public:
+		static const std::size_t max_alignment = 64;
+
+		explicit FrameArena(std::size_t capacity = 1 << 20) : block_memory(nullptr), block(nullptr), capacity(0), offset(0), overflow_bytes(0), high_water(0)
+		{
+			setCapacity(capacity);
+		}
+		~FrameArena()
+		{
+			freeOverflow();
+			std::free(block_memory);
+		}
+
+		FrameArena(const FrameArena&) = delete;
+		FrameArena& operator=(const FrameArena&) = delete;
+
+		// align has to be a power of two no larger than max_alignment
+		void* allocate(std::size_t size, std::size_t align)
+		{
+			std::size_t current = offset.load(std::memory_order_relaxed);
+			while (true)
+			{
+				std::size_t begin = (current + align - 1) & ~(align - 1);
+				std::size_t end = begin + size;
+				if (end > capacity)
+					return allocateOverflow(size, align);
+				if (offset.compare_exchange_weak(current, end, std::memory_order_relaxed))
+					return block + begin;
+			}
+		}
+
+		// everything allocated since the last reset is gone after this. Not thread safe
+		void reset()
+		{
+			std::size_t used = getUsed();
+			if (used > high_water)
+				high_water = used;
+
+			if (!overflow.empty())
+			{
+				freeOverflow();
+				setCapacity(used + used / 2);
+			}
+			offset.store(0, std::memory_order_relaxed);
+		}
+
+		// drops everything allocated since the last reset
+		void setCapacity(std::size_t bytes)
+		{
+			bytes = (bytes + max_alignment - 1) & ~(max_alignment - 1);
+			std::free(block_memory);
+			block_memory = nullptr;
+			block = nullptr;
+			if (bytes)
+			{
+				// offsets are aligned relative to the block, so its start has the largest alignment
+				block_memory = std::malloc(bytes + max_alignment);
+				if (!block_memory)
+					throw std::bad_alloc();
+				block = (unsigned char*)(((std::uintptr_t)block_memory + max_alignment - 1) & ~(std::uintptr_t)(max_alignment - 1));
+			}
+			capacity = bytes;
+			offset.store(0, std::memory_order_relaxed);
+		}
+
+		std::size_t getCapacity() const
+		{
+			return capacity;
+		}
+		// bytes handed out since the last reset, including what went to the heap
+		std::size_t getUsed() const
+		{
+			std::size_t used = offset.load(std::memory_order_relaxed);
+			if (used > capacity)
+				used = capacity;
+			return used + overflow_bytes;
+		}
+		// most bytes any step needed so far
+		std::size_t getHighWater() const
+		{
+			return high_water;
+		}
+
+	private:
+		void* block_memory;
+		unsigned char* block;
+		std::size_t capacity;
+		std::atomic<std::size_t> offset;
+
+		std::mutex overflow_mutex;
+		std::vector<void*> overflow;
+		std::size_t overflow_bytes;
+
+		std::size_t high_water;
+
+		void* allocateOverflow(std::size_t size, std::size_t align)
+		{
+			std::lock_guard<std::mutex> lock(overflow_mutex);
+			void* raw = std::malloc(size + align);
+			if (!raw)
+				throw std::bad_alloc();
+			overflow.push_back(raw);
+			overflow_bytes += size + align;
+			std::uintptr_t aligned = ((std::uintptr_t)raw + align - 1) & ~(std::uintptr_t)(align - 1);
+			return (void*)aligned;
+		}
+
+		void freeOverflow()
+		{
+			for (std::size_t i = 0; i < overflow.size(); ++i)
+				std::free(overflow[i]);
+			overflow.clear();
+			overflow_bytes = 0;
+		}
+	};
+
+	// std allocator on top of a FrameArena. Freeing is a no-op, the arena's reset takes everything back.
+	// Without an arena it falls back to the heap
+	template<typename T>
+	class FrameAllocator
+	{
+	public:
+		typedef T value_type;
+		typedef std::true_type propagate_on_container_copy_assignment;
+		typedef std::true_type propagate_on_container_move_assignment;
+		typedef std::true_type propagate_on_container_swap;
+
+		FrameArena* arena;
+
+		FrameAllocator() : arena(nullptr) {}
+		explicit FrameAllocator(FrameArena* arena) : arena(arena) {}
+		template<typename U>
+		FrameAllocator(const FrameAllocator<U>& other) : arena(other.arena) {}
+
+		T* allocate(std::size_t n)
+		{
+			if (arena)
+				return (T*)arena->allocate(n * sizeof(T), alignof(T));
+			return (T*)::operator new(n * sizeof(T));
+		}
+
+		void deallocate(T* p, std::size_t)
+		{
+			if (!arena)
+				::operator delete(p);
+		}
+
+		template<typename U>
+		bool operator==(const FrameAllocator<U>& other) const { return arena == other.arena; }
+		template<typename U>
+		bool operator!=(const FrameAllocator<U>& other) const { return arena != other.arena; }
+	};
+
+	template<typename T>
+	using FrameVector = std::vector<T, FrameAllocator<T>>;
+
+	// empties v and lets it allocate from arena from now on, or from the heap for nullptr. Vectors have to
+	// be moved off an arena before it resets
+	template<typename T>
+	inline void bindArena(FrameVector<T>& v, FrameArena* arena)
+	{
+		FrameVector<T>(FrameAllocator<T>(arena)).swap(v);
+	}
+}
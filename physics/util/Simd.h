@@ -0,0 +1,127 @@
+#pragma once
+
+// instruction sets the compiler was allowed to use for this translation unit
+
+#if defined(__AVX2__)
+#define FIZ_AVX2
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FIZ_SSE2
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define FIZ_X86
+#endif
+
+#if defined(FIZ_X86)
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// kernels picked at run time are compiled for their instruction set whatever the build flags say.
+// MSVC allows every intrinsic anywhere
+#if defined(FIZ_X86) && (defined(__GNUC__) || defined(__clang__))
+#define FIZ_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define FIZ_TARGET_AVX2
+#endif
+
+// for small dispatch functions in hot loops that the compiler's size heuristics would leave out of line
+#if defined(_MSC_VER)
+#define FIZ_FORCE_INLINE __forceinline
+#elif defined(__GNUC__) || defined(__clang__)
+#define FIZ_FORCE_INLINE inline __attribute__((always_inline))
+#else
+#define FIZ_FORCE_INLINE inline
+#endif
+
+namespace fiz
+{
+	// arrays meant for SIMD loops are padded to a multiple of this many floats
+	static const unsigned int simd_width = 8;
+
+	inline unsigned int simdPadded(unsigned int count)
+	{
+		return (count + simd_width - 1) & ~(simd_width - 1);
+	}
+
+	// true if the processor and the OS both support AVX2, for kernels dispatched at run time
+	inline bool cpuSupportsAvx2()
+	{
+#if defined(FIZ_X86) && (defined(__GNUC__) || defined(__clang__))
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") != 0;
+#elif defined(FIZ_X86) && defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		// AVX state has to be enabled by the OS as well
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return false;
+#endif
+	}
+
+	// a register of floats at the widest width the build allows, for kernels written once for every
+	// instruction set. Loads and stores expect memory aligned to 32 bytes
+	struct SimdFloat
+	{
+#if defined(FIZ_AVX2)
+		static const unsigned int width = 8;
+		__m256 v;
+
+		SimdFloat() {}
+		SimdFloat(__m256 v) : v(v) {}
+		static inline SimdFloat load(const float* p) { return _mm256_load_ps(p); }
+		static inline SimdFloat set1(float f) { return _mm256_set1_ps(f); }
+		inline void store(float* p) const { _mm256_store_ps(p, v); }
+
+		friend inline SimdFloat operator+(SimdFloat a, SimdFloat b) { return _mm256_add_ps(a.v, b.v); }
+		friend inline SimdFloat operator-(SimdFloat a, SimdFloat b) { return _mm256_sub_ps(a.v, b.v); }
+		friend inline SimdFloat operator*(SimdFloat a, SimdFloat b) { return _mm256_mul_ps(a.v, b.v); }
+		friend inline SimdFloat min(SimdFloat a, SimdFloat b) { return _mm256_min_ps(a.v, b.v); }
+		friend inline SimdFloat max(SimdFloat a, SimdFloat b) { return _mm256_max_ps(a.v, b.v); }
+#elif defined(FIZ_SSE2)
+		static const unsigned int width = 4;
+		__m128 v;
+
+		SimdFloat() {}
+		SimdFloat(__m128 v) : v(v) {}
+		static inline SimdFloat load(const float* p) { return _mm_load_ps(p); }
+		static inline SimdFloat set1(float f) { return _mm_set1_ps(f); }
+		inline void store(float* p) const { _mm_store_ps(p, v); }
+
+		friend inline SimdFloat operator+(SimdFloat a, SimdFloat b) { return _mm_add_ps(a.v, b.v); }
+		friend inline SimdFloat operator-(SimdFloat a, SimdFloat b) { return _mm_sub_ps(a.v, b.v); }
+		friend inline SimdFloat operator*(SimdFloat a, SimdFloat b) { return _mm_mul_ps(a.v, b.v); }
+		friend inline SimdFloat min(SimdFloat a, SimdFloat b) { return _mm_min_ps(a.v, b.v); }
+		friend inline SimdFloat max(SimdFloat a, SimdFloat b) { return _mm_max_ps(a.v, b.v); }
+#else
+		static const unsigned int width = 4;
+		float v[4];
+
+		SimdFloat() {}
+		static inline SimdFloat load(const float* p) { SimdFloat r; for (unsigned int i = 0; i < 4; ++i) r.v[i] = p[i]; return r; }
+		static inline SimdFloat set1(float f) { SimdFloat r; for (unsigned int i = 0; i < 4; ++i) r.v[i] = f; return r; }
+		inline void store(float* p) const { for (unsigned int i = 0; i < 4; ++i) p[i] = v[i]; }
+
+		friend inline SimdFloat operator+(SimdFloat a, SimdFloat b) { for (unsigned int i = 0; i < 4; ++i) a.v[i] += b.v[i]; return a; }
+		friend inline SimdFloat operator-(SimdFloat a, SimdFloat b) { for (unsigned int i = 0; i < 4; ++i) a.v[i] -= b.v[i]; return a; }
+		friend inline SimdFloat operator*(SimdFloat a, SimdFloat b) { for (unsigned int i = 0; i < 4; ++i) a.v[i] *= b.v[i]; return a; }
+		friend inline SimdFloat min(SimdFloat a, SimdFloat b) { for (unsigned int i = 0; i < 4; ++i) a.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return a; }
+		friend inline SimdFloat max(SimdFloat a, SimdFloat b) { for (unsigned int i = 0; i < 4; ++i) a.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return a; }
+#endif
+	};
+}
@@ -0,0 +1,310 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace fiz
+{
+	// tasks spawned through one group, wait on the group to know they have all run
+	class TaskGroup
+	{
+	public:
+		TaskGroup() : pending(0)
+		{
+
+		}
+
+		TaskGroup(const TaskGroup&) = delete;
+		TaskGroup& operator=(const TaskGroup&) = delete;
+
+	private:
+		friend class ThreadPool;
+
+		std::atomic<unsigned int> pending;
+	};
+
+	// work stealing pool. Every thread owns a queue, it pushes and pops at the back while idle threads
+	// steal from the front, so a thread keeps working on the most recent (cache warm) part of its loop
+	// while others take the large halves left over. Queue 0 belongs to the thread driving the pool,
+	// which helps with the work whenever it waits. With no workers everything runs inline
+	class ThreadPool
+	{
+	public:
+		explicit ThreadPool(unsigned int thread_count = 0) : queues(new WorkQueue[thread_count + 1]), queue_count(thread_count + 1),
+			stop(false), queued(0), sleepers(0)
+		{
+			for (unsigned int i = 0; i < thread_count; ++i)
+				workers.emplace_back(&ThreadPool::workerLoop, this, i + 1);
+		}
+		~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stop = true;
+			}
+			wake.notify_all();
+			for (unsigned int i = 0; i < workers.size(); ++i)
+				workers[i].join();
+			delete[] queues;
+		}
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		unsigned int getThreadCount() const
+		{
+			return (unsigned int)workers.size();
+		}
+
+		// 1 to getThreadCount() on this pool's workers, 0 on any other thread. Indexes per-thread scratch data
+		unsigned int getThreadIndex() const
+		{
+			return threadIndex();
+		}
+
+		// queues fn() on the calling thread's queue. fn is not copied, it has to outlive wait(group)
+		template<typename F>
+		void run(TaskGroup& group, const F& fn)
+		{
+			if (workers.empty())
+			{
+				fn();
+				return;
+			}
+
+			Task task;
+			task.context = &fn;
+			task.invoke = &invokeTask<F>;
+			task.begin = 0;
+			task.end = 1;
+			task.grain = 1;
+			task.group = &group;
+			group.pending.fetch_add(1);
+			push(threadIndex(), task);
+		}
+
+		// runs queued tasks until every task of the group is done, including the ones they spawned
+		void wait(TaskGroup& group)
+		{
+			unsigned int self = threadIndex();
+			while (group.pending.load(std::memory_order_acquire) != 0)
+			{
+				Task task;
+				if (findTask(self, task))
+					execute(self, task);
+				else
+					std::this_thread::yield();
+			}
+		}
+
+		// calls fn(begin, end) over [0, count) in chunks of at most grain and returns once all are done.
+		// Ranges are split in halves on demand, so only idle threads pay for the splitting
+		template<typename F>
+		void parallelFor(unsigned int count, unsigned int grain, const F& fn)
+		{
+			if (count == 0)
+				return;
+			if (grain == 0)
+				grain = 1;
+			if (workers.empty() || count <= grain)
+			{
+				fn(0, count);
+				return;
+			}
+
+			TaskGroup group;
+			Task task;
+			task.context = &fn;
+			task.invoke = &invokeRange<F>;
+			task.begin = 0;
+			task.end = count;
+			task.grain = grain;
+			task.group = &group;
+			group.pending.store(1);
+
+			unsigned int self = threadIndex();
+			execute(self, task);
+			wait(group);
+		}
+
+	private:
+		struct Task
+		{
+			const void* context;
+			void (*invoke)(const void*, unsigned int, unsigned int);
+			unsigned int begin;
+			unsigned int end;
+			unsigned int grain;
+			TaskGroup* group;
+		};
+
+		// owner works at the back, thieves take from head. Storage is reused once the queue drains
+		struct alignas(64) WorkQueue
+		{
+			std::mutex mutex;
+			std::vector<Task> tasks;
+			unsigned int head;
+
+			WorkQueue() : head(0) {}
+		};
+
+		std::vector<std::thread> workers;
+		WorkQueue* queues;
+		unsigned int queue_count;
+
+		std::mutex mutex;
+		std::condition_variable wake;
+		bool stop;
+		std::atomic<unsigned int> queued;   // tasks sitting in any queue
+		std::atomic<unsigned int> sleepers; // workers blocked on wake
+
+		template<typename F>
+		static void invokeTask(const void* context, unsigned int begin, unsigned int end)
+		{
+			(*(const F*)context)();
+		}
+		template<typename F>
+		static void invokeRange(const void* context, unsigned int begin, unsigned int end)
+		{
+			(*(const F*)context)(begin, end);
+		}
+
+		// which pool the current thread works for, if any
+		struct WorkerIdentity
+		{
+			const ThreadPool* pool;
+			unsigned int index;
+		};
+		static WorkerIdentity& currentWorker()
+		{
+			thread_local WorkerIdentity identity = { nullptr, 0 };
+			return identity;
+		}
+
+		// workers are numbered from 1, any other thread uses queue 0. That includes workers of other pools,
+		// so a job on one world's pool can step another world
+		unsigned int threadIndex() const
+		{
+			const WorkerIdentity& identity = currentWorker();
+			return identity.pool == this ? identity.index : 0;
+		}
+
+		void push(unsigned int self, const Task& task)
+		{
+			{
+				WorkQueue& queue = queues[self];
+				std::lock_guard<std::mutex> lock(queue.mutex);
+				queue.tasks.push_back(task);
+			}
+			queued.fetch_add(1);
+
+			// taking the lock orders this against a worker checking queued on its way to sleep
+			if (sleepers.load() != 0)
+			{
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+				}
+				wake.notify_one();
+			}
+		}
+
+		bool pop(unsigned int self, Task& task)
+		{
+			WorkQueue& queue = queues[self];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.head == queue.tasks.size())
+				return false;
+
+			task = queue.tasks.back();
+			queue.tasks.pop_back();
+			if (queue.head == queue.tasks.size())
+			{
+				queue.tasks.clear();
+				queue.head = 0;
+			}
+			queued.fetch_sub(1);
+			return true;
+		}
+
+		bool steal(unsigned int victim, Task& task)
+		{
+			WorkQueue& queue = queues[victim];
+			std::unique_lock<std::mutex> lock(queue.mutex, std::try_to_lock);
+			if (!lock.owns_lock() || queue.head == queue.tasks.size())
+				return false;
+
+			task = queue.tasks[queue.head++];
+			if (queue.head == queue.tasks.size())
+			{
+				queue.tasks.clear();
+				queue.head = 0;
+			}
+			queued.fetch_sub(1);
+			return true;
+		}
+
+		bool findTask(unsigned int self, Task& task)
+		{
+			if (pop(self, task))
+				return true;
+			for (unsigned int i = 1; i < queue_count; ++i)
+			{
+				if (steal((self + i) % queue_count, task))
+					return true;
+			}
+			return false;
+		}
+
+		// keeps the lower half of a range and leaves the upper half for others until it is small enough
+		void execute(unsigned int self, Task task)
+		{
+			while (task.end - task.begin > task.grain)
+			{
+				Task upper = task;
+				upper.begin = task.begin + (task.end - task.begin) / 2;
+				task.end = upper.begin;
+				task.group->pending.fetch_add(1);
+				push(self, upper);
+			}
+
+			task.invoke(task.context, task.begin, task.end);
+			task.group->pending.fetch_sub(1, std::memory_order_release);
+		}
+
+		void workerLoop(unsigned int self)
+		{
+			currentWorker().pool = this;
+			currentWorker().index = self;
+
+			unsigned int idle = 0;
+			while (true)
+			{
+				Task task;
+				if (findTask(self, task))
+				{
+					execute(self, task);
+					idle = 0;
+					continue;
+				}
+
+				// spin a little, steps come in bursts of short loops
+				if (++idle < 64)
+				{
+					std::this_thread::yield();
+					continue;
+				}
+
+				std::unique_lock<std::mutex> lock(mutex);
+				sleepers.fetch_add(1);
+				wake.wait(lock, [this] { return stop || queued.load() != 0; });
+				sleepers.fetch_sub(1);
+				if (stop)
+					return;
+				idle = 0;
+			}
+		}
+	};
+}
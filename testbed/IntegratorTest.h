@@ -0,0 +1,84 @@
+#pragma once
+
+#include <iostream>
+#include <cstring>
+
+#include "../physics/Body.h"
+#include "../physics/dynamics/Integrator.h"
+
+// mixed awake and sleeping bodies, some without mass, some below the ground or above the ceiling.
+// 37 bodies so every vector loop leaves a scalar tail
+inline void fillIntegratorTestBodies(fiz::BodyStorage& bodies)
+{
+	const unsigned int count = 37;
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		float f = (float)i;
+		bodies.add(glm::vec3(f * 0.5f - 9.0f, (float)(i % 7) * 6.0f - 3.0f, f * 0.25f));
+		bodies.vel_x[i] = glm::sin(f) * 3.0f;
+		bodies.vel_y[i] = glm::cos(f * 1.7f) * 5.0f;
+		bodies.vel_z[i] = glm::sin(f * 0.3f);
+		bodies.force_x[i] = (float)(i % 5) - 2.0f;
+		bodies.force_y[i] = (float)(i % 3) * 4.0f;
+		bodies.force_z[i] = -f * 0.1f;
+		bodies.inv_mass[i] = i % 4 == 0 ? 0.0f : 1.0f / (1.0f + f * 0.1f);
+		bodies.ground_offset[i] = -0.5f;
+		bodies.sleep_time[i] = f * 0.01f;
+		if (i % 3 == 1)
+			bodies.awake[i] = 0;
+	}
+}
+
+inline bool sameFloats(const fiz::FloatArray& a, const fiz::FloatArray& b)
+{
+	return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(float)) == 0;
+}
+
+inline bool sameIntegration(const fiz::BodyStorage& a, const fiz::BodyStorage& b)
+{
+	return sameFloats(a.pos_x, b.pos_x) && sameFloats(a.pos_y, b.pos_y) && sameFloats(a.pos_z, b.pos_z) &&
+		sameFloats(a.vel_x, b.vel_x) && sameFloats(a.vel_y, b.vel_y) && sameFloats(a.vel_z, b.vel_z) &&
+		sameFloats(a.force_x, b.force_x) && sameFloats(a.force_y, b.force_y) && sameFloats(a.force_z, b.force_z) &&
+		a.sleep_time == b.sleep_time;
+}
+
+// runs every integration kernel the processor has on the same bodies and checks they agree to the bit
+// with the scalar one. Returns false on failure
+inline bool runIntegratorTest()
+{
+	fiz::IntegrationStep step;
+	step.dt = 1.0f / 60.0f;
+	step.gravity = glm::vec3(0.0f, -9.8f, 0.0f);
+	step.ground_restitution = 0.9f;
+	step.ceiling = 30.0f;
+	step.sleep_distance = 0.25f * step.dt;
+
+	fiz::BodyStorage scalar;
+	fillIntegratorTestBodies(scalar);
+	for (unsigned int s = 0; s < 10; ++s)
+		fiz::integrate_detail::integrateScalar(scalar, 0, scalar.size(), step);
+
+	bool passed = true;
+#if defined(FIZ_SSE2)
+	fiz::BodyStorage sse2;
+	fillIntegratorTestBodies(sse2);
+	for (unsigned int s = 0; s < 10; ++s)
+		fiz::integrate_detail::integrateSse2(sse2, 0, sse2.size(), step);
+	bool sse2_same = sameIntegration(scalar, sse2);
+	std::cout << "integrator sse2: " << (sse2_same ? "matches" : "differs from") << " scalar" << std::endl;
+	passed = passed && sse2_same;
+#endif
+#if defined(FIZ_X86)
+	if (fiz::cpuSupportsAvx2())
+	{
+		fiz::BodyStorage avx2;
+		fillIntegratorTestBodies(avx2);
+		for (unsigned int s = 0; s < 10; ++s)
+			fiz::integrate_detail::integrateAvx2(avx2, 0, avx2.size(), step);
+		bool avx2_same = sameIntegration(scalar, avx2);
+		std::cout << "integrator avx2: " << (avx2_same ? "matches" : "differs from") << " scalar" << std::endl;
+		passed = passed && avx2_same;
+	}
+#endif
+	return passed;
+}
@@ -12,12 +12,21 @@
 
 #include "../physics/World.h"
 #include "../debug/DebugRenderer.h"
+#include "ShapeBenchmark.h"
+#include "PolyhedronTest.h"
+#include "IntegratorTest.h"
 
 #include <vector>
 #include <ctime>
 
 #define DEBUG_LOG
 #define DEBIG_TIME
+// runs the GJK dispatch benchmark on the demo scene instead of the testbed
+//#define SHAPE_BENCHMARK
+// drops a polyhedron on a box and checks it comes to rest on top, exits with 1 if not
+//#define POLYHEDRON_TEST
+// compares the scalar and SIMD integration kernels, exits with 1 if they disagree
+//#define INTEGRATOR_TEST
 
 #ifdef DEBUG_LOG
 #define print(x) std::cout << x << std::endl
@@ -118,6 +127,17 @@ void processInput(GLFWwindow* window, DebugRenderer& renderer, float deltaTime)
 
 int main()
 {
+#ifdef SHAPE_BENCHMARK
+	runShapeBenchmark();
+	return 0;
+#endif
+#ifdef POLYHEDRON_TEST
+	return runPolyhedronTest() ? 0 : 1;
+#endif
+#ifdef INTEGRATOR_TEST
+	return runIntegratorTest() ? 0 : 1;
+#endif
+
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+
+#include "../physics/World.h"
+
+// unit cube as a hull with triangles, 8 vertices numbered by their x, y and z signs
+inline fiz::ShapeHandle createPolyhedronCube(fiz::World& world, float half)
+{
+	fiz::ShapeHandle handle = world.createShape<fiz::Polyhedron>(8);
+	fiz::Polyhedron* cube = (fiz::Polyhedron*)world.getShape(handle);
+	for (unsigned int i = 0; i < 8; ++i)
+		cube->setVertex(i, glm::vec3(i & 1 ? half : -half, i & 2 ? half : -half, i & 4 ? half : -half));
+
+	std::vector<unsigned int> triangles = {
+		0, 4, 6, 0, 6, 2, // -x
+		1, 3, 7, 1, 7, 5, // +x
+		0, 1, 5, 0, 5, 4, // -y
+		2, 6, 7, 2, 7, 3, // +y
+		0, 2, 3, 0, 3, 1, // -z
+		4, 5, 7, 4, 7, 6  // +z
+	};
+	cube->setTriangles(triangles);
+	return handle;
+}
+
+// drops a polyhedron cube on a box resting on the ground. The cube needs a mass to take contact
+// impulses, without one it fell through the box and pushed it aside. Returns false on failure
+inline bool runPolyhedronTest()
+{
+	fiz::World world;
+	while (world.bodies.size() > 0)
+		world.destroyBody(world.bodies.getHandle(0));
+
+	fiz::ShapeHandle box_shape = world.createShape<fiz::AABB>(glm::vec3(-0.5f), glm::vec3(0.5f));
+	fiz::BodyHandle box = world.createBody(glm::vec3(0.0f, 0.5f, 0.0f));
+	world.getBody(box).addShape(world.getShape(box_shape));
+
+	fiz::BodyHandle cube = world.createBody(glm::vec3(0.0f, 3.0f, 0.0f));
+	world.getBody(cube).addShape(world.getShape(createPolyhedronCube(world, 0.5f)));
+
+	for (unsigned int i = 0; i < 240; ++i)
+		world.step(1.0f / 60.0f);
+
+	float cube_mass = world.getBody(cube).getMass();
+	glm::vec3 box_pos = world.getBody(box).getPosition();
+	glm::vec3 cube_pos = world.getBody(cube).getPosition();
+
+	bool massive = glm::abs(cube_mass - 1.0f) < 1e-4f;
+	bool box_resting = glm::length(box_pos - glm::vec3(0.0f, 0.5f, 0.0f)) < 0.05f;
+	bool cube_on_box = glm::length(cube_pos - glm::vec3(0.0f, 1.5f, 0.0f)) < 0.05f;
+
+	bool passed = massive && box_resting && cube_on_box;
+	std::cout << "polyhedron on box: " << (passed ? "passed" : "failed") << ", mass " << cube_mass
+		<< ", box y " << box_pos.y << ", cube y " << cube_pos.y << std::endl;
+	return passed;
+}
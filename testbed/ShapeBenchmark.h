@@ -0,0 +1,127 @@
+#pragma once
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include "../physics/World.h"
+#include "../physics/collision/GJK.h"
+
+// ConvexProxy with the support call going through the vtable, the way GJK dispatched before
+struct VirtualConvexProxy
+{
+	fiz::Shape* shape;
+	glm::vec3 pos;
+	float radius;
+
+	VirtualConvexProxy(fiz::Shape* shape, glm::vec3 pos, bool core = true) : shape(shape), pos(pos), radius(0.0f)
+	{
+		if (shape->shape_type == fiz::SPHERE_TYPE)
+		{
+			fiz::Sphere* sphere = (fiz::Sphere*)shape;
+			this->pos += sphere->pos;
+			if (core)
+				radius = sphere->rad;
+		}
+	}
+
+	inline glm::vec3 support(glm::vec3 axis) const
+	{
+		if (shape->shape_type == fiz::SPHERE_TYPE)
+		{
+			if (radius > 0.0f)
+				return pos;
+			return pos - ((fiz::Sphere*)shape)->pos + shape->support(axis);
+		}
+		return pos + shape->support(axis);
+	}
+};
+
+template<typename Proxy>
+std::vector<Proxy> benchmarkProxies(fiz::World& world, bool core)
+{
+	std::vector<Proxy> proxies;
+	for (unsigned int i = 0; i < world.bodies.size(); ++i)
+		proxies.emplace_back(world.bodies.shapes[i][0], world.bodies.getPosition(i), core);
+	return proxies;
+}
+
+// ns per support query on the full shapes of the scene
+template<typename Proxy>
+double timeSupport(fiz::World& world, unsigned int rounds, float& checksum)
+{
+	std::vector<Proxy> proxies = benchmarkProxies<Proxy>(world, false);
+
+	glm::vec3 sum(0.0f);
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int r = 0; r < rounds; ++r)
+	{
+		float angle = (float)r * 0.37f;
+		glm::vec3 axis(glm::cos(angle), glm::sin(angle * 1.3f), glm::sin(angle));
+		for (unsigned int i = 0; i < proxies.size(); ++i)
+			sum += proxies[i].support(axis);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+
+	checksum = sum.x + sum.y + sum.z;
+	return std::chrono::duration<double, std::nano>(end - start).count() / ((double)rounds * proxies.size());
+}
+
+// ns per GJK distance query between every pair of bodies of the scene
+template<typename Proxy>
+double timeGjk(fiz::World& world, unsigned int rounds, float& checksum)
+{
+	std::vector<Proxy> proxies = benchmarkProxies<Proxy>(world, true);
+
+	checksum = 0.0f;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int r = 0; r < rounds; ++r)
+	{
+		for (unsigned int i = 0; i < proxies.size(); ++i)
+		{
+			for (unsigned int j = i + 1; j < proxies.size(); ++j)
+			{
+				fiz::GjkResult result;
+				fiz::gjk(proxies[i], proxies[j], result);
+				checksum += result.distance;
+			}
+		}
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+
+	double queries = (double)rounds * (proxies.size() * (proxies.size() - 1) / 2);
+	return std::chrono::duration<double, std::nano>(end - start).count() / queries;
+}
+
+inline void printBenchmark(const char* name, double virtual_ns, double switch_ns, bool same)
+{
+	std::cout << name << ": virtual " << virtual_ns << " ns, switch " << switch_ns << " ns, speedup "
+		<< virtual_ns / switch_ns << "x" << (same ? "" : " (results differ)") << std::endl;
+}
+
+// compares virtual and switch dispatch of the support function on the World() demo scene. Both
+// variants run alternately and the best of the runs counts, so warmup and noise hit both alike
+inline void runShapeBenchmark()
+{
+	fiz::World world;
+	const unsigned int runs = 7;
+
+	double support_virtual = 1e30, support_switch = 1e30;
+	double gjk_virtual = 1e30, gjk_switch = 1e30;
+	float sum_virtual, sum_switch;
+	bool support_same = true, gjk_same = true;
+	for (unsigned int run = 0; run < runs; ++run)
+	{
+		support_virtual = std::min(support_virtual, timeSupport<VirtualConvexProxy>(world, 20000, sum_virtual));
+		support_switch = std::min(support_switch, timeSupport<fiz::ConvexProxy>(world, 20000, sum_switch));
+		support_same = support_same && sum_virtual == sum_switch;
+
+		gjk_virtual = std::min(gjk_virtual, timeGjk<VirtualConvexProxy>(world, 100, sum_virtual));
+		gjk_switch = std::min(gjk_switch, timeGjk<fiz::ConvexProxy>(world, 100, sum_switch));
+		gjk_same = gjk_same && sum_virtual == sum_switch;
+	}
+
+	printBenchmark("support", support_virtual, support_switch, support_same);
+	printBenchmark("gjk", gjk_virtual, gjk_switch, gjk_same);
+}